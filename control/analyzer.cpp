@@ -19,8 +19,10 @@
 */
 #include "analyzer.h"
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <limits>
+#include <tuple>
 
 std::vector<RGB> Analyzer::makeCanvas()
 {
@@ -33,6 +35,14 @@ void Analyzer::setCellDepth(size_t horizontal, size_t vertical)
   vertical_celldepth_ = vertical;
 }
 
+/**
+ * @brief Return the position of the i'th bisection line across a dimension of the provided length.
+ */
+static size_t bisectPosition(size_t length, size_t bisects_per_side, size_t i)
+{
+  return (length - 1) / (bisects_per_side + 1) * (i + 1);
+}
+
 Box Analyzer::findBorders(const Image& image, size_t bisects_per_side) const
 {
   // Create 4 vectors to hold the results of the bisection procedure.
@@ -66,8 +76,8 @@ Box Analyzer::findBorders(const Image& image, size_t bisects_per_side) const
   for (size_t i = 0; i < bisects_per_side; i++)
   {
     size_t tmp = 0;
-    size_t mid_y = (image.getHeight() - 1) / (bisects_per_side + 1) * (i + 1);
-    size_t mid_x = (image.getWidth() - 1) / (bisects_per_side + 1) * (i + 1);
+    size_t mid_y = bisectPosition(image.getHeight(), bisects_per_side, i);
+    size_t mid_x = bisectPosition(image.getWidth(), bisects_per_side, i);
 
     // Perform left bound
     tmp = mid_x;
@@ -95,42 +105,260 @@ Box Analyzer::findBorders(const Image& image, size_t bisects_per_side) const
   return bounds;
 }
 
-void Analyzer::sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
-                      std::vector<RGB>& canvas)
+std::vector<Box> Analyzer::captureRegions(size_t width, size_t height, const Box& bounds,
+                                          size_t bisects_per_side) const
+{
+  std::vector<Box> res;
+
+  // The strips holding the cells along each side of the bounds, these are read most often so they go first.
+  const size_t right = std::max(bounds.x_min, bounds.x_max - std::min(bounds.width(), horizontal_celldepth_));
+  const size_t bottom = std::max(bounds.y_min, bounds.y_max - std::min(bounds.height(), vertical_celldepth_));
+  res.emplace_back(bounds.x_min, bounds.x_max, bounds.y_min, std::min(bounds.y_max, bounds.y_min + vertical_celldepth_));
+  res.emplace_back(bounds.x_min, bounds.x_max, bottom, bounds.y_max);
+  res.emplace_back(bounds.x_min, std::min(bounds.x_max, bounds.x_min + horizontal_celldepth_), bounds.y_min,
+                   bounds.y_max);
+  res.emplace_back(right, bounds.x_max, bounds.y_min, bounds.y_max);
+
+  // The lines the bisections of findBorders run over.
+  for (size_t i = 0; i < bisects_per_side; i++)
+  {
+    const size_t mid_y = bisectPosition(height, bisects_per_side, i);
+    const size_t mid_x = bisectPosition(width, bisects_per_side, i);
+    res.emplace_back(0, width, mid_y, mid_y + 1);
+    res.emplace_back(mid_x, mid_x + 1, 0, height);
+  }
+  return res;
+}
+
+/**
+ * @brief Sample the points of a single box and return their average color.
+ */
+static RGB sampleBox(const Image& screen, const Box& bounds, const BoxSamples& box)
+{
+  // Run over the sample points and create average color.
+  uint32_t R = 0;
+  uint32_t G = 0;
+  uint32_t B = 0;
+  uint32_t total = 0;
+  for (const auto& p : box.points)
+  {
+    const uint32_t color = screen.pixel(p.first + bounds.x_min, p.second + bounds.y_min);
+    R += (color >> 16) & 0xFF;
+    G += (color >> 8) & 0xFF;
+    B += color & 0xFF;
+    total += 255;
+  }
+
+  if (total == 0)
+  {
+    // This can only happen if there are no samples in the box, which should never happen.
+    throw std::runtime_error("No samples in this box: " + std::string(box.box));
+  }
+
+  RGB color;
+  color.R = R * 255 / total;
+  color.G = G * 255 / total;
+  color.B = B * 255 / total;
+  return color;
+}
+
+/**
+ * @brief Helper to sample into any indexable canvas, either a vector of colors or a view on the lights' frame.
+ */
+template <typename Canvas>
+static void sampleInto(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+                       Canvas& canvas, const std::vector<Box>* damage = nullptr)
 {
   for (size_t box_i = 0; box_i < boxed_samples.size(); box_i++)
   {
     const auto& box = boxed_samples[box_i];
     auto& canvas_pixel = canvas[box_i];
 
-    // Run over the sample points and create average color.
-    uint32_t R = 0;
-    uint32_t G = 0;
-    uint32_t B = 0;
-    uint32_t total = 0;
-    for (const auto& p : box.points)
+    // Skip boxes that didn't change, if the damage is known.
+    if (damage)
     {
-      const uint32_t color = screen.pixel(p.first + bounds.x_min, p.second + bounds.y_min);
-      R += (color >> 16) & 0xFF;
-      G += (color >> 8) & 0xFF;
-      B += color & 0xFF;
-      total += 255;
+      const Box on_screen(box.box.x_min + bounds.x_min, box.box.x_max + bounds.x_min, box.box.y_min + bounds.y_min,
+                          box.box.y_max + bounds.y_min);
+      if (std::none_of(damage->begin(), damage->end(), [&](const Box& d) { return d.intersects(on_screen); }))
+      {
+        continue;
+      }
     }
 
-    if (total == 0)
+    // Assign the calculated average color to the canvas.
+    const RGB color = sampleBox(screen, bounds, box);
+    canvas_pixel.R = color.R;
+    canvas_pixel.G = color.G;
+    canvas_pixel.B = color.B;
+  }
+}
+
+void Analyzer::sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+                      std::vector<RGB>& canvas)
+{
+  sampleInto(screen, bounds, boxed_samples, canvas);
+}
+
+void Analyzer::sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+                      Lights::CanvasView canvas)
+{
+  sampleInto(screen, bounds, boxed_samples, canvas);
+}
+
+void Analyzer::sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+                      std::vector<RGB>& canvas, const std::vector<Box>& damage)
+{
+  sampleInto(screen, bounds, boxed_samples, canvas, &damage);
+}
+
+void Analyzer::sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+                      std::vector<RGB>& canvas, const std::vector<size_t>& boxes)
+{
+  for (const auto box_i : boxes)
+  {
+    canvas[box_i] = sampleBox(screen, bounds, boxed_samples[box_i]);
+  }
+}
+
+BoxChangeDetector::BoxChangeDetector(size_t probes_per_box, size_t refresh_frames)
+  : probes_per_box_(std::max<size_t>(1, probes_per_box)), refresh_frames_(refresh_frames)
+{
+}
+
+const std::vector<size_t>& BoxChangeDetector::update(const Image& screen, const Box& bounds,
+                                                     const std::vector<BoxSamples>& boxed_samples)
+{
+  // Without signatures for these boxes, all of them have to be sampled.
+  const bool all = signatures_.size() != boxed_samples.size();
+  signatures_.resize(boxed_samples.size());
+  changed_.clear();
+  for (size_t box_i = 0; box_i < boxed_samples.size(); box_i++)
+  {
+    // The probes are spread evenly over the sample points of the box, FNV-1a over their colors is the signature.
+    const auto& points = boxed_samples[box_i].points;
+    const size_t step = std::max<size_t>(1, points.size() / probes_per_box_);
+    uint64_t signature = 0xcbf29ce484222325ULL;
+    for (size_t i = step / 2; i < points.size(); i += step)
     {
-      // This can only happen if there are no samples in the box, which should never happen.
-      throw std::runtime_error("No samples in this box: " + std::string(box.box));
+      signature ^= screen.pixel(points[i].first + bounds.x_min, points[i].second + bounds.y_min);
+      signature *= 0x100000001b3ULL;
     }
 
-    // Assign the calculated average color to the canvas.
-    canvas_pixel.R = R * 255 / total;
-    canvas_pixel.G = G * 255 / total;
-    canvas_pixel.B = B * 255 / total;
+    // Each box is also sampled once every refresh interval, this catches changes that fall between the probes. The
+    // boxes take turns, which spreads the refreshes over the frames.
+    const bool refresh = refresh_frames_ && ((box_i + frame_) % refresh_frames_ == 0);
+    if (all || refresh || (signature != signatures_[box_i]))
+    {
+      changed_.push_back(box_i);
+    }
+    signatures_[box_i] = signature;
+  }
+  frame_++;
+  return changed_;
+}
+
+void BoxChangeDetector::reset()
+{
+  signatures_.clear();
+}
+
+SamplePlan::SamplePlan(const std::vector<Layout>& layouts)
+{
+  // Collect every sample point of every box in screen coordinates, then order them such that equal points are adjacent.
+  struct Entry
+  {
+    size_t y;
+    size_t x;
+    uint32_t target;
+    bool operator<(const Entry& other) const
+    {
+      return std::tie(y, x, target) < std::tie(other.y, other.x, other.target);
+    }
+  };
+  std::vector<Entry> entries;
+  uint32_t box_index = 0;
+  for (const auto& layout : layouts)
+  {
+    layout_offsets_.push_back(box_index);
+    for (const auto& box : *layout.samples)
+    {
+      counts_.push_back(box.points.size());
+      for (const auto& p : box.points)
+      {
+        entries.push_back({ p.second + layout.bounds.y_min, p.first + layout.bounds.x_min, box_index });
+      }
+      box_index++;
+    }
+  }
+  layout_offsets_.push_back(box_index);
+  sums_.resize(box_index);
+  std::sort(entries.begin(), entries.end());
+
+  // Merge equal points.
+  targets_.reserve(entries.size());
+  for (const auto& entry : entries)
+  {
+    if (points_.empty() || (points_.back().x != entry.x) || (points_.back().y != entry.y))
+    {
+      points_.push_back({ static_cast<uint32_t>(entry.x), static_cast<uint32_t>(entry.y),
+                          static_cast<uint32_t>(targets_.size()), 0 });
+    }
+    targets_.push_back(entry.target);
+    points_.back().target_count++;
+  }
+}
+
+void SamplePlan::sample(const Image& screen, const std::vector<std::vector<RGB>*>& canvases)
+{
+  std::fill(sums_.begin(), sums_.end(), std::array<uint32_t, 3>{ 0, 0, 0 });
+  for (const auto& point : points_)
+  {
+    const uint32_t color = screen.pixel(point.x, point.y);
+    const uint32_t R = (color >> 16) & 0xFF;
+    const uint32_t G = (color >> 8) & 0xFF;
+    const uint32_t B = color & 0xFF;
+    const uint32_t* target = targets_.data() + point.first_target;
+    for (const uint32_t* end = target + point.target_count; target != end; target++)
+    {
+      auto& sum = sums_[*target];
+      sum[0] += R;
+      sum[1] += G;
+      sum[2] += B;
+    }
+  }
+
+  // Assign the average colors to the canvases.
+  for (size_t layout = 0; layout < canvases.size(); layout++)
+  {
+    auto& canvas = *canvases[layout];
+    for (size_t box = layout_offsets_[layout]; box < layout_offsets_[layout + 1]; box++)
+    {
+      const uint32_t total = counts_[box] * 255;
+      if (total == 0)
+      {
+        // This can only happen if there are no samples in the box, which should never happen.
+        throw std::runtime_error("No samples in box " + std::to_string(box - layout_offsets_[layout]));
+      }
+      auto& canvas_pixel = canvas[box - layout_offsets_[layout]];
+      canvas_pixel.R = sums_[box][0] * 255 / total;
+      canvas_pixel.G = sums_[box][1] * 255 / total;
+      canvas_pixel.B = sums_[box][2] * 255 / total;
+    }
   }
 }
 
-std::vector<BoxSamples> Analyzer::makeBoxSamples(const size_t dist_between_samples, const Box& bounds)
+size_t SamplePlan::pointCount() const
+{
+  return points_.size();
+}
+
+size_t SamplePlan::targetCount() const
+{
+  return targets_.size();
+}
+
+std::vector<BoxSamples> Analyzer::makeBoxSamples(const size_t dist_between_samples, const Box& bounds, size_t offset_x,
+                                                 size_t offset_y)
 {
   // Get the boxes associated to these bounds.
   auto boxes = Lights::getBoxes(bounds.width(), bounds.height(), horizontal_celldepth_, vertical_celldepth_);
@@ -145,10 +373,12 @@ std::vector<BoxSamples> Analyzer::makeBoxSamples(const size_t dist_between_sampl
     size_t height = std::min<size_t>(1, (box.x_max - box.x_min) / dist_between_samples + 1);
     res[i].points.reserve(width * height);
 
-    // now add samples.
-    for (size_t y = box.y_min; y < box.y_max; y += dist_between_samples)
+    // now add samples, the offsets wrap around in boxes smaller than them so no box is left without samples.
+    const size_t first_y = box.y_min + (box.height() ? offset_y % box.height() : 0);
+    const size_t first_x = box.x_min + (box.width() ? offset_x % box.width() : 0);
+    for (size_t y = first_y; y < box.y_max; y += dist_between_samples)
     {
-      for (size_t x = box.x_min; x < box.x_max; x += dist_between_samples)
+      for (size_t x = first_x; x < box.x_max; x += dist_between_samples)
       {
         res[i].points.emplace_back(x, y);
       }
@@ -157,9 +387,146 @@ std::vector<BoxSamples> Analyzer::makeBoxSamples(const size_t dist_between_sampl
   return res;
 }
 
+std::vector<std::vector<BoxSamples>> Analyzer::makeBoxSampleVariants(const size_t dist_between_samples,
+                                                                     const Box& bounds, size_t steps)
+{
+  steps = std::max<size_t>(1, std::min(steps, dist_between_samples));
+  std::vector<std::vector<BoxSamples>> res;
+  res.reserve(steps * steps);
+  for (size_t i = 0; i < steps * steps; i++)
+  {
+    // Each column of offsets is paired with each row once, stepping through the rows diagonally.
+    const size_t column = i % steps;
+    const size_t row = (i / steps + column) % steps;
+    res.push_back(makeBoxSamples(dist_between_samples, bounds, column * dist_between_samples / steps,
+                                 row * dist_between_samples / steps));
+  }
+  return res;
+}
+
+std::vector<BoxSamples> Analyzer::makeBoxSamplesByCount(const size_t samples_per_box, const Box& bounds)
+{
+  auto boxes = Lights::getBoxes(bounds.width(), bounds.height(), horizontal_celldepth_, vertical_celldepth_);
+  std::vector<BoxSamples> res{ boxes.size() };
+  for (size_t i = 0; i < boxes.size(); i++)
+  {
+    const Box& box = boxes[i];
+    res[i].box = box;
+    if (!box.width() || !box.height())
+    {
+      continue;
+    }
+
+    // Square cells with the requested area, at least one cell and at most one per pixel in each direction.
+    const double area = static_cast<double>(box.width() * box.height());
+    const double spacing = std::sqrt(area / std::max<size_t>(1, samples_per_box));
+    const size_t columns = std::min(box.width(), std::max<size_t>(1, std::lround(box.width() / spacing)));
+    const size_t rows = std::min(box.height(), std::max<size_t>(1, std::lround(box.height() / spacing)));
+    res[i].points.reserve(columns * rows);
+    for (size_t row = 0; row < rows; row++)
+    {
+      const size_t y = box.y_min + ((2 * row + 1) * box.height()) / (2 * rows);
+      for (size_t column = 0; column < columns; column++)
+      {
+        res[i].points.emplace_back(box.x_min + ((2 * column + 1) * box.width()) / (2 * columns), y);
+      }
+    }
+  }
+  return res;
+}
+
+TemporalFilter::TemporalFilter(size_t frames) : frames_(std::max<size_t>(1, frames))
+{
+}
+
+void TemporalFilter::apply(std::vector<RGB>& canvas)
+{
+  if (frames_ == 1)
+  {
+    return;
+  }
+  if (sums_.size() != canvas.size())
+  {
+    reset();
+    sums_.resize(canvas.size());
+    history_.assign(frames_, std::vector<RGB>(canvas.size()));
+  }
+
+  // Replace the oldest canvas in the sums with the new one.
+  auto& oldest = history_[index_];
+  for (size_t i = 0; i < canvas.size(); i++)
+  {
+    if (filled_ == frames_)
+    {
+      sums_[i][0] -= oldest[i].R;
+      sums_[i][1] -= oldest[i].G;
+      sums_[i][2] -= oldest[i].B;
+    }
+    sums_[i][0] += canvas[i].R;
+    sums_[i][1] += canvas[i].G;
+    sums_[i][2] += canvas[i].B;
+  }
+  oldest = canvas;
+  index_ = (index_ + 1) % frames_;
+  filled_ = std::min(filled_ + 1, frames_);
+
+  for (size_t i = 0; i < canvas.size(); i++)
+  {
+    canvas[i].R = sums_[i][0] / filled_;
+    canvas[i].G = sums_[i][1] / filled_;
+    canvas[i].B = sums_[i][2] / filled_;
+  }
+}
+
+void TemporalFilter::reset()
+{
+  index_ = 0;
+  filled_ = 0;
+  for (auto& sum : sums_)
+  {
+    sum = { 0, 0, 0 };
+  }
+}
+
+uint64_t Analyzer::fingerprint(const Image& image, size_t columns, size_t rows)
+{
+  const size_t width = image.getWidth();
+  const size_t height = image.getHeight();
+
+  // FNV-1a over the probe pixels, each pixel is mixed in as a whole.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  auto mix = [&hash](uint64_t value) {
+    hash ^= value;
+    hash *= 0x100000001b3ULL;
+  };
+  mix(width);
+  mix(height);
+  if (!width || !height)
+  {
+    return hash;
+  }
+
+  // Probe the centers of a grid of cells, the probes don't move between frames.
+  for (size_t row = 0; row < rows; row++)
+  {
+    const size_t y = ((2 * row + 1) * height) / (2 * rows);
+    for (size_t column = 0; column < columns; column++)
+    {
+      const size_t x = ((2 * column + 1) * width) / (2 * columns);
+      mix(image.pixel(x, y));
+    }
+  }
+  return hash;
+}
+
 void Analyzer::boxColorizer(const std::vector<RGB>& canvas, Image& image)
 {
-  auto boxes = Lights::getBoxes(image.getWidth(), image.getHeight(), 50, 50);
+  boxColorizer(canvas, image, Box(0, image.getWidth(), 0, image.getHeight()));
+}
+
+void Analyzer::boxColorizer(const std::vector<RGB>& canvas, Image& image, const Box& area)
+{
+  auto boxes = Lights::getBoxes(area.width(), area.height(), 50, 50);
 
   // now that we have the boxes and the canvas, we can color each individual box.
   for (size_t box_i = 0; box_i < boxes.size(); box_i++)
@@ -171,7 +538,7 @@ void Analyzer::boxColorizer(const std::vector<RGB>& canvas, Image& image)
     {
       for (size_t x = box.x_min; x < box.x_max; x++)
       {
-        image.setPixel(x, y, color.toUint32());
+        image.setPixel(x + area.x_min, y + area.y_min, color.toUint32());
       }
     }
   }
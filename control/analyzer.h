@@ -20,6 +20,7 @@
 #ifndef ANALYZER_H
 #define ANALYZER_H
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <sstream>
@@ -37,6 +38,134 @@ struct BoxSamples
   std::vector<std::pair<size_t, size_t>> points;
 };
 
+/**
+ * @brief Plan to sample several layouts of boxes in a single pass over the screen. The sample points of all layouts are
+ *        merged and ordered by their position in memory, points that layouts have in common are read once and their
+ *        color is added to each box they belong to. This makes an extra layout on the same part of the screen cheap.
+ */
+class SamplePlan
+{
+public:
+  /**
+   * @brief A layout of boxes and the bounds its sample points are relative to, as passed to Analyzer::sample.
+   */
+  struct Layout
+  {
+    Box bounds;                              //!< The bounds the boxed samples were made for, in screen coordinates.
+    const std::vector<BoxSamples>* samples;  //!< The boxed samples of the layout.
+  };
+
+  SamplePlan() = default;
+
+  /**
+   * @brief Create the plan for the provided layouts.
+   */
+  SamplePlan(const std::vector<Layout>& layouts);
+
+  /**
+   * @brief Sample the screen, outputting the colors of each layout's boxes into the canvas of that layout.
+   * @param screen The screen to sample.
+   * @param canvases The canvas for each layout, in the order of the layouts.
+   */
+  void sample(const Image& screen, const std::vector<std::vector<RGB>*>& canvases);
+
+  /**
+   * @brief Return the number of pixels read for each sample.
+   */
+  size_t pointCount() const;
+
+  /**
+   * @brief Return the number of sample points of all layouts combined, pixels shared by layouts count multiple times.
+   */
+  size_t targetCount() const;
+
+private:
+  /**
+   * @brief A pixel to read and the range of boxes in targets_ it contributes to.
+   */
+  struct Point
+  {
+    uint32_t x;             //!< The x coordinate on the screen.
+    uint32_t y;             //!< The y coordinate on the screen.
+    uint32_t first_target;  //!< Index of the first box in targets_.
+    uint32_t target_count;  //!< Number of boxes in targets_.
+  };
+
+  std::vector<Point> points_;                  //!< The pixels to read, ordered by their position in memory.
+  std::vector<uint32_t> targets_;              //!< Box of each contribution, numbered over all layouts.
+  std::vector<size_t> layout_offsets_;         //!< First box of each layout, the total number of boxes at the end.
+  std::vector<uint32_t> counts_;               //!< Number of sample points in each box.
+  std::vector<std::array<uint32_t, 3>> sums_;  //!< Accumulated channels of each box.
+};
+
+/**
+ * @brief Finds the boxes whose content changed by comparing signatures made from a few probe pixels in each box. Only
+ *        those boxes have to be sampled again, which makes the cost of sampling follow the content that changed.
+ */
+class BoxChangeDetector
+{
+public:
+  /**
+   * @brief Create the detector.
+   * @param probes_per_box The number of sample points of each box that make up its signature.
+   * @param refresh_frames Each box is sampled at least once in this many frames, changes between the probes are
+   *        noticed this late at most. 0 disables the refresh.
+   */
+  BoxChangeDetector(size_t probes_per_box = 8, size_t refresh_frames = 60);
+
+  /**
+   * @brief Compute the signatures of the boxes and return the indices of the boxes that have to be sampled, those
+   *        that changed since the previous call and those that are due for a refresh.
+   * @param screen The screen as captured.
+   * @param bounds The bounds used to create the boxed samples.
+   * @param boxed_samples The boxed samples, all boxes are returned if they differ in number from the previous call.
+   */
+  const std::vector<size_t>& update(const Image& screen, const Box& bounds,
+                                    const std::vector<BoxSamples>& boxed_samples);
+
+  /**
+   * @brief Forget the signatures, the next update returns all boxes. Use this when the boxed samples are made again.
+   */
+  void reset();
+
+private:
+  size_t probes_per_box_;             //!< Number of probes in each signature.
+  size_t refresh_frames_;             //!< Interval in frames at which each box is sampled regardless.
+  size_t frame_{ 0 };                 //!< Number of updates, decides which boxes are refreshed.
+  std::vector<uint64_t> signatures_;  //!< Signature of each box at the previous update.
+  std::vector<size_t> changed_;       //!< The boxes returned by the last update.
+};
+
+/**
+ * @brief Averages each box over the last frames. Combined with sample points that shift each frame this makes every
+ *        pixel contribute to the colors, at the cost of the output lagging behind by up to that many frames.
+ */
+class TemporalFilter
+{
+public:
+  /**
+   * @brief Create a filter that averages over the provided number of frames, 1 passes the frames through.
+   */
+  TemporalFilter(size_t frames = 1);
+
+  /**
+   * @brief Add a canvas to the history and replace it with the average of the frames in the history.
+   */
+  void apply(std::vector<RGB>& canvas);
+
+  /**
+   * @brief Forget the history, the next canvas is passed through.
+   */
+  void reset();
+
+private:
+  size_t frames_;                              //!< The number of frames to average over.
+  size_t index_{ 0 };                          //!< Entry of the history that is replaced next.
+  size_t filled_{ 0 };                         //!< Number of entries in the history.
+  std::vector<std::vector<RGB>> history_;      //!< The last canvases.
+  std::vector<std::array<uint32_t, 3>> sums_;  //!< Sum of the channels of each box over the history.
+};
+
 /**
  * @brief Class that can perform analysis of the screen to come to the colors that can be sent to the LED's.
  * General approach consists of three steps:
@@ -71,13 +200,56 @@ public:
    */
   Box findBorders(const Image& image, size_t bisects_per_side = 4) const;
 
+  /**
+   * @brief Return the regions of an image that findBorders() and sample() read, the lines the bisections run over and
+   *        the strips along the bounds that hold the cells. Capturing only these regions suffices for the analysis.
+   * @param width The width of the image.
+   * @param height The height of the image.
+   * @param bounds The bounds the samples are made for, as returned by findBorders.
+   * @param bisects_per_side The number of bisections findBorders() performs for each side.
+   */
+  std::vector<Box> captureRegions(size_t width, size_t height, const Box& bounds, size_t bisects_per_side = 4) const;
+
+  /**
+   * @brief Compute a fingerprint of an image from a fixed, sparse grid of probe pixels. Identical images have the same
+   *        fingerprint, so a frame with the fingerprint of the previous one can skip the analysis. A change that falls
+   *        between the probes goes unnoticed.
+   * @param image The image to fingerprint.
+   * @param columns The number of probes in horizontal direction.
+   * @param rows The number of probes in vertical direction.
+   */
+  static uint64_t fingerprint(const Image& image, size_t columns = 64, size_t rows = 36);
+
   /**
    * @brief This computes a list of boxes for the given bounds and calculates the position of the sample points inside
    *        each box.
    * @param dist_between_samples The distance between samples in both horizontal and vertical direction (inside the box)
    * @param bounds The bounds of the entire region that will be analyzed, as created by findBorders.
+   * @param offset_x The horizontal offset of the first sample from the left of each box.
+   * @param offset_y The vertical offset of the first sample from the top of each box.
    */
-  std::vector<BoxSamples> makeBoxSamples(const size_t dist_between_samples, const Box& bounds);
+  std::vector<BoxSamples> makeBoxSamples(const size_t dist_between_samples, const Box& bounds, size_t offset_x = 0,
+                                         size_t offset_y = 0);
+
+  /**
+   * @brief Make variants of the boxed samples, each with the sample grid shifted by a different offset. Sampling a
+   *        different variant each frame covers a grid that is steps times as dense over steps * steps frames, with
+   *        steps equal to the distance between samples every pixel is sampled. Consecutive variants are shifted in
+   *        both directions.
+   * @param dist_between_samples The distance between samples of each variant.
+   * @param bounds The bounds of the entire region that will be analyzed, as created by findBorders.
+   * @param steps The number of offsets in each direction, at most the distance between samples.
+   */
+  std::vector<std::vector<BoxSamples>> makeBoxSampleVariants(const size_t dist_between_samples, const Box& bounds,
+                                                             size_t steps);
+
+  /**
+   * @brief This computes a list of boxes for the given bounds with about the same number of sample points in each box,
+   *        regardless of its size. The points are spread evenly over a grid that follows the shape of the box.
+   * @param samples_per_box The number of sample points for each box.
+   * @param bounds The bounds of the entire region that will be analyzed, as created by findBorders.
+   */
+  std::vector<BoxSamples> makeBoxSamplesByCount(const size_t samples_per_box, const Box& bounds);
 
   /**
    * @brief Sample a screen, given the screen the start position of the region to analyze, the precompued boxed samples
@@ -90,11 +262,42 @@ public:
   void sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
               std::vector<RGB>& canvas);
 
+  /**
+   * @brief Sample a screen directly into the frame of the lights, see the other overload for details.
+   * @param canvas The view on the lights' frame that receives the led colors.
+   */
+  void sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+              Lights::CanvasView canvas);
+
+  /**
+   * @brief Sample only the boxes that overlap with damaged regions of the screen, the other entries of the canvas are
+   *        left as they are. See the first overload for the other parameters.
+   * @param damage The regions of the screen that changed since the canvas was sampled.
+   */
+  void sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+              std::vector<RGB>& canvas, const std::vector<Box>& damage);
+
+  /**
+   * @brief Sample only the provided boxes, as returned by BoxChangeDetector::update, the other entries of the canvas
+   *        are left as they are. See the first overload for the other parameters.
+   * @param boxes The indices of the boxes to sample.
+   */
+  void sample(const Image& screen, const Box& bounds, const std::vector<BoxSamples>& boxed_samples,
+              std::vector<RGB>& canvas, const std::vector<size_t>& boxes);
+
   /**
    * @brief Colorize a screen based on the colors in the canvas. This creates boxes on the edge that are 50 pixels deep.
    * @param canvas The canvas to draw on the screen.
    * @param[in, out] Outer borders of the image will get the boxes drawn on them.
    */
   void boxColorizer(const std::vector<RGB>& canvas, Image& image);
+
+  /**
+   * @brief Colorize an area of a screen in place, the boxes are drawn along the edges of the area.
+   * @param canvas The canvas to draw on the screen.
+   * @param[in, out] image The screen that holds the area.
+   * @param area The area of the screen to draw the boxes in.
+   */
+  void boxColorizer(const std::vector<RGB>& canvas, Image& image, const Box& area);
 };
 #endif
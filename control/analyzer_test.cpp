@@ -18,8 +18,84 @@
   SOFTWARE.
 */
 #include "analyzer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <limits>
+#include "pixelsniffReplay.h"
+#include "pixelsniffY4M.h"
 #include "platform.h"
+#include "recording.h"
+#include "timing.h"
+#include "y4m.h"
+
+/**
+ * @brief Create a synthetic frame; a moving gradient with black bars at the top and bottom.
+ */
+Image makeFrame(size_t width, size_t height, size_t frame)
+{
+  Image::Bitmap bitmap(height, std::vector<uint32_t>(width, 0));
+  const size_t bar = height / 8;
+  for (size_t y = bar; y < height - bar; y++)
+  {
+    for (size_t x = 0; x < width; x++)
+    {
+      const uint32_t r = (x + frame) & 0xFF;
+      const uint32_t g = (y * 2) & 0xFF;
+      const uint32_t b = (x < width / 2) ? 0x40 : (frame * 3) & 0xFF;
+      bitmap[y][x] = (r << 16) | (g << 8) | b;
+    }
+  }
+  return Image{ bitmap };
+}
+
+/**
+ * @brief Return true if the two images are identical, only considering the border strips if border is non-zero.
+ */
+bool sameContents(const Image& a, const Image::Bitmap& b, size_t border)
+{
+  for (size_t y = 0; y < a.getHeight(); y++)
+  {
+    for (size_t x = 0; x < a.getWidth(); x++)
+    {
+      const bool stored = (border == 0) || (y < border) || (y + border >= a.getHeight()) || (x < border) ||
+                          (x + border >= a.getWidth());
+      if ((stored ? (a.pixel(x, y) & 0x00FFFFFF) : 0) != b[y][x])
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Image that counts the reads of pixels that lie outside of a set of regions.
+ */
+class RegionCheckImage : public Image
+{
+public:
+  RegionCheckImage(const Image& image, const std::vector<Box>& regions) : Image(image), regions_(regions)
+  {
+  }
+
+  uint32_t pixel(size_t x, size_t y) const
+  {
+    bool inside = false;
+    for (const auto& box : regions_)
+    {
+      inside |= (x >= box.x_min) && (x < box.x_max) && (y >= box.y_min) && (y < box.y_max);
+    }
+    outside += !inside;
+    return Image::pixel(x, y);
+  }
+
+  mutable size_t outside{ 0 };  //!< Number of reads outside the regions.
+
+private:
+  std::vector<Box> regions_;  //!< The regions reads are allowed in.
+};
 
 int main(int argc, char* argv[])
 {
@@ -28,6 +104,19 @@ int main(int argc, char* argv[])
     std::cout << "./" << argv[0] << " capture image_out.bin" << std::endl;
     std::cout << "./" << argv[0] << " borderbisect image_in.bin image_out.ppm" << std::endl;
     std::cout << "./" << argv[0] << " convert image_in.bin image_out.ppm" << std::endl;
+    std::cout << "./" << argv[0] << " record recording.dlr [frames] [border]" << std::endl;
+    std::cout << "./" << argv[0] << " replay recording.dlr|video.y4m [realtime]" << std::endl;
+    std::cout << "./" << argv[0] << " y4m video.y4m [frames] [width] [height]" << std::endl;
+    std::cout << "./" << argv[0] << " roundtrip [frames]" << std::endl;
+    std::cout << "./" << argv[0] << " regions [image_in.bin]" << std::endl;
+    std::cout << "./" << argv[0] << " damage" << std::endl;
+    std::cout << "./" << argv[0] << " rate" << std::endl;
+    std::cout << "./" << argv[0] << " view" << std::endl;
+    std::cout << "./" << argv[0] << " plan [iterations]" << std::endl;
+    std::cout << "./" << argv[0] << " fingerprint [iterations]" << std::endl;
+    std::cout << "./" << argv[0] << " changes" << std::endl;
+    std::cout << "./" << argv[0] << " jitter [steps]" << std::endl;
+    std::cout << "./" << argv[0] << " density" << std::endl;
     return 1;
   }
 
@@ -95,5 +184,590 @@ int main(int argc, char* argv[])
     outcontent << image.imageToPPM();
     outcontent.close();
   }
+  // Record the screen.
+  if (std::string(argv[1]) == "record")
+  {
+    const size_t frames = (argc >= 4) ? std::atoi(argv[3]) : 600;
+    const size_t border = (argc >= 5) ? std::atoi(argv[4]) : 0;
+    PixelSniffer::Ptr sniff = getSniffer();
+    sniff->connect();
+    sniff->selectRootWindow();
+    Recorder recorder(argv[2], border);
+    Limiter limiter{ 60 };
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < frames; i++)
+    {
+      limiter.sleep();
+      if (!sniff->grabContent())
+      {
+        continue;
+      }
+      const auto timestamp =
+          std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      const auto res = sniff->getFullResolution();
+      recorder.add(*sniff->getScreen(), timestamp.count(), res.first, res.second);
+    }
+    recorder.close();
+    std::cout << "Frames: " << recorder.size() << " bytes: " << recorder.bytes() << std::endl;
+  }
+
+  // Benchmark the analyzer on a recording.
+  if (std::string(argv[1]) == "replay")
+  {
+    const bool realtime = (argc >= 4) ? std::atoi(argv[3]) : false;
+    const std::string filename = argv[2];
+    std::unique_ptr<PixelSnifferPlayback> playback;
+    if ((filename.size() > 4) && (filename.substr(filename.size() - 4) == ".y4m"))
+    {
+      playback = std::make_unique<PixelSnifferY4M>(filename, realtime);
+    }
+    else
+    {
+      playback = std::make_unique<PixelSnifferReplay>(filename, realtime);
+    }
+    PixelSnifferPlayback& sniff = *playback;
+    Analyzer analyzer;
+    auto canvas = analyzer.makeCanvas();
+    Box sample_bounds;
+    std::vector<BoxSamples> sample_points;
+    Measure grab;
+    Measure analysis;
+    while (true)
+    {
+      grab.start();
+      if (!sniff.grabContent())
+      {
+        break;
+      }
+      grab.stop();
+      analysis.start();
+      const auto image = sniff.getScreen();
+      const Box bounds = analyzer.findBorders(*image);
+      if (!(bounds == sample_bounds))
+      {
+        sample_points = analyzer.makeBoxSamples(15, bounds);
+        sample_bounds = bounds;
+      }
+      analyzer.sample(*image, bounds, sample_points, canvas);
+      analysis.stop();
+    }
+    std::cout << "Frames: " << sniff.grabbed() << " grab avg: " << grab.average()
+              << " usec analysis avg: " << analysis.average() << " usec" << std::endl;
+  }
+
+  // Write a video, read it back and compare, the conversion is lossy but close. Then time reading it.
+  if (std::string(argv[1]) == "y4m")
+  {
+    const size_t frames = (argc >= 4) ? std::atoi(argv[3]) : 120;
+    const size_t width = (argc >= 5) ? std::atoi(argv[4]) : 1920;
+    const size_t height = (argc >= 6) ? std::atoi(argv[5]) : 1080;
+    {
+      Y4MWriter writer(argv[2], width, height, 60);
+      for (size_t i = 0; i < frames; i++)
+      {
+        writer.write(makeFrame(width, height, i));
+      }
+    }
+
+    // Sharp edges lose some color to the shared chroma samples, on average the colors are close.
+    PixelSnifferY4M sniff(argv[2], false);
+    size_t failures = 0;
+    uint64_t error = 0;
+    uint64_t channels = 0;
+    for (size_t i = 0; i < std::min<size_t>(frames, 5); i++)
+    {
+      failures += !sniff.grabContent();
+      const Image expected = makeFrame(width, height, i);
+      const auto image = sniff.getScreen();
+      for (size_t y = 0; y < height; y++)
+      {
+        for (size_t x = 0; x < width; x++)
+        {
+          const uint32_t a = expected.pixel(x, y);
+          const uint32_t b = image->pixel(x, y);
+          for (size_t shift = 0; shift <= 16; shift += 8)
+          {
+            error += std::abs(int((a >> shift) & 0xFF) - int((b >> shift) & 0xFF));
+            channels++;
+          }
+        }
+      }
+    }
+    const double mean_error = channels ? static_cast<double>(error) / channels : 0.0;
+    failures += mean_error > 2;
+    std::cout << "Mean channel error: " << mean_error << std::endl;
+
+    PixelSnifferY4M timed(argv[2], false);
+    Measure reading;
+    reading.start();
+    size_t read = 0;
+    while (timed.grabContent())
+    {
+      read++;
+    }
+    reading.stop();
+    const double rate = read / (reading.average() / 1e6);
+    std::cout << "Read " << read << " frames of " << width << " x " << height << " at " << rate << " fps" << std::endl;
+    failures += (read != frames) || timed.grabContent() || !timed.finished();
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // Verify the analysis only reads pixels within the capture regions.
+  if (std::string(argv[1]) == "regions")
+  {
+    const Image image = (argc >= 3) ? Image::readContents(argv[2]) : makeFrame(1920, 1200, 0);
+    Analyzer analyzer;
+    const Box bounds = analyzer.findBorders(image);
+    const auto regions = analyzer.captureRegions(image.getWidth(), image.getHeight(), bounds);
+    RegionCheckImage checked(image, regions);
+    const Box checked_bounds = analyzer.findBorders(checked);
+    auto canvas = analyzer.makeCanvas();
+    analyzer.sample(checked, bounds, analyzer.makeBoxSamples(15, bounds), canvas);
+
+    size_t region_pixels = 0;
+    for (const auto& region : regions)
+    {
+      region_pixels += region.width() * region.height();
+    }
+    std::cout << "Bounds: " << std::string(bounds) << " regions: " << regions.size() << " holding " << region_pixels
+              << " of " << image.getWidth() * image.getHeight() << " pixels" << std::endl;
+    std::cout << "Reads outside regions: " << checked.outside << std::endl;
+    return (checked.outside || !(checked_bounds == bounds)) ? 1 : 0;
+  }
+
+  // Verify sampling only the damaged boxes yields the same canvas as sampling everything.
+  if (std::string(argv[1]) == "damage")
+  {
+    Analyzer analyzer;
+    Image image = makeFrame(1920, 1200, 0);
+    const Box bounds = analyzer.findBorders(image);
+    const auto samples = analyzer.makeBoxSamples(15, bounds);
+    auto canvas = analyzer.makeCanvas();
+    analyzer.sample(image, bounds, samples, canvas);
+
+    // Paint a rectangle in the top left and one on the right border.
+    const std::vector<Box> damage{ Box(10, 400, 150, 300), Box(1800, 1920, 600, 610) };
+    for (const auto& box : damage)
+    {
+      for (size_t y = box.y_min; y < box.y_max; y++)
+      {
+        for (size_t x = box.x_min; x < box.x_max; x++)
+        {
+          image.setPixel(x, y, 0x00FF8000);
+        }
+      }
+    }
+    auto expected = analyzer.makeCanvas();
+    analyzer.sample(image, bounds, samples, expected);
+    analyzer.sample(image, bounds, samples, canvas, damage);
+
+    size_t differences = 0;
+    for (size_t i = 0; i < canvas.size(); i++)
+    {
+      differences += canvas[i].toUint32() != expected[i].toUint32();
+    }
+    std::cout << "Differences: " << differences << std::endl;
+    return differences ? 1 : 0;
+  }
+
+  // Verify analyzing a view on part of a frame matches analyzing a copy of that part, as for one strip per monitor.
+  if (std::string(argv[1]) == "view")
+  {
+    Analyzer analyzer;
+    auto desktop = std::make_shared<Image>(makeFrame(3840, 1200, 7));
+    size_t differences = 0;
+    for (const auto& area : { Box(0, 1920, 0, 1200), Box(1920, 3840, 0, 1200), Box(1000, 2500, 100, 1100) })
+    {
+      Image::Bitmap bitmap(area.height(), std::vector<uint32_t>(area.width(), 0));
+      for (size_t y = 0; y < area.height(); y++)
+      {
+        for (size_t x = 0; x < area.width(); x++)
+        {
+          bitmap[y][x] = desktop->pixel(x + area.x_min, y + area.y_min);
+        }
+      }
+      const Image copy{ bitmap };
+      const ImageView view{ desktop, area };
+
+      const Box bounds = analyzer.findBorders(copy);
+      const auto samples = analyzer.makeBoxSamples(15, bounds);
+      auto expected = analyzer.makeCanvas();
+      analyzer.sample(copy, bounds, samples, expected);
+      auto canvas = analyzer.makeCanvas();
+      analyzer.sample(view, bounds, samples, canvas);
+
+      differences += !(analyzer.findBorders(view) == bounds);
+      for (size_t i = 0; i < canvas.size(); i++)
+      {
+        differences += canvas[i].toUint32() != expected[i].toUint32();
+      }
+
+      // Copying the rows of the view yields the area.
+      std::vector<uint32_t> row(area.width());
+      for (size_t y = 0; y < area.height(); y++)
+      {
+        view.copyRow(y, row.data());
+        differences += !(row == bitmap[y]);
+      }
+      std::cout << "Area: " << std::string(area) << " bounds: " << std::string(bounds) << std::endl;
+    }
+    std::cout << "Differences: " << differences << std::endl;
+    return differences ? 1 : 0;
+  }
+
+  // Fingerprints of identical frames match, those of different frames don't.
+  if (std::string(argv[1]) == "fingerprint")
+  {
+    const size_t count = (argc >= 3) ? std::atoi(argv[2]) : 100;
+    const Image first = makeFrame(1920, 1200, 3);
+    const Image same = makeFrame(1920, 1200, 3);
+    const Image other = makeFrame(1920, 1200, 4);
+    Image touched = first;
+    touched.setPixel(1920 / 128, 1200 / 72, first.pixel(1920 / 128, 1200 / 72) ^ 0x010101);
+
+    Measure timing;
+    uint64_t fingerprint = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+      timing.start();
+      fingerprint = Analyzer::fingerprint(first);
+      timing.stop();
+    }
+
+    size_t failures = 0;
+    failures += fingerprint != Analyzer::fingerprint(same);
+    failures += fingerprint == Analyzer::fingerprint(other);
+    failures += fingerprint == Analyzer::fingerprint(touched);  // The changed pixel is the first probe.
+    failures += fingerprint == Analyzer::fingerprint(makeFrame(1280, 1200, 3));
+    std::cout << "Fingerprint: " << std::hex << fingerprint << std::dec << " avg: " << timing.average() << " usec"
+              << std::endl;
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // Change a small area of the screen, only the boxes it covers should be sampled again.
+  if (std::string(argv[1]) == "changes")
+  {
+    Analyzer analyzer;
+    Image image = makeFrame(1920, 1200, 3);
+    const Box bounds = analyzer.findBorders(image);
+    const auto samples = analyzer.makeBoxSamples(15, bounds);
+    BoxChangeDetector detector(8, 0);
+    auto canvas = analyzer.makeCanvas();
+
+    size_t failures = 0;
+    const auto first = detector.update(image, bounds, samples);
+    analyzer.sample(image, bounds, samples, canvas, first);
+    failures += first.size() != samples.size();
+    failures += !detector.update(image, bounds, samples).empty();
+
+    // Something like a clock in the corner of the taskbar.
+    for (size_t y = bounds.y_max - 40; y < bounds.y_max; y++)
+    {
+      for (size_t x = bounds.x_max - 120; x < bounds.x_max; x++)
+      {
+        image.setPixel(x, y, 0xFFFFFF);
+      }
+    }
+    const auto changed = detector.update(image, bounds, samples);
+    analyzer.sample(image, bounds, samples, canvas, changed);
+    auto expected = analyzer.makeCanvas();
+    analyzer.sample(image, bounds, samples, expected);
+    size_t differences = 0;
+    for (size_t i = 0; i < canvas.size(); i++)
+    {
+      differences += canvas[i].toUint32() != expected[i].toUint32();
+    }
+    failures += changed.empty() || (changed.size() > 8) || differences;
+    std::cout << "Changed boxes: " << changed.size() << " of " << samples.size() << " differences: " << differences
+              << std::endl;
+
+    // With a refresh interval, each box is sampled once in that many frames.
+    BoxChangeDetector refreshing(8, 10);
+    refreshing.update(image, bounds, samples);
+    size_t refreshed = 0;
+    for (size_t i = 0; i < 10; i++)
+    {
+      refreshed += refreshing.update(image, bounds, samples).size();
+    }
+    failures += refreshed != samples.size();
+    std::cout << "Refreshed in 10 frames: " << refreshed << std::endl;
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // A fine pattern aliases with a fixed grid, the jittered grid averaged over its variants approaches every pixel.
+  if (std::string(argv[1]) == "jitter")
+  {
+    const size_t steps = (argc >= 3) ? std::atoi(argv[2]) : 15;
+    const size_t distance = 15;
+    Image::Bitmap bitmap(1200, std::vector<uint32_t>(1920, 0));
+    for (size_t y = 0; y < 1200; y++)
+    {
+      for (size_t x = 0; x < 1920; x += distance)
+      {
+        bitmap[y][x] = 0xFFFFFF;  // Lines exactly one sample distance apart.
+      }
+    }
+    const Image image{ bitmap };
+    const Box bounds(0, 1920, 0, 1200);
+    Analyzer analyzer;
+
+    auto dense = analyzer.makeCanvas();
+    analyzer.sample(image, bounds, analyzer.makeBoxSamples(1, bounds), dense);
+    auto fixed = analyzer.makeCanvas();
+    analyzer.sample(image, bounds, analyzer.makeBoxSamples(distance, bounds), fixed);
+
+    const auto variants = analyzer.makeBoxSampleVariants(distance, bounds, steps);
+    TemporalFilter filter(variants.size());
+    auto jittered = analyzer.makeCanvas();
+    Measure timing;
+    for (const auto& points : variants)
+    {
+      timing.start();
+      analyzer.sample(image, bounds, points, jittered);
+      filter.apply(jittered);
+      timing.stop();
+    }
+
+    // The window main uses, steps consecutive variants.
+    TemporalFilter short_filter(steps);
+    auto short_jittered = analyzer.makeCanvas();
+    for (size_t i = 0; i < steps + steps / 2; i++)
+    {
+      analyzer.sample(image, bounds, variants[i], short_jittered);
+      short_filter.apply(short_jittered);
+    }
+
+    auto maxError = [&](const std::vector<RGB>& canvas) {
+      int error = 0;
+      for (size_t i = 0; i < canvas.size(); i++)
+      {
+        error = std::max(error, std::abs(int(canvas[i].R) - int(dense[i].R)));
+      }
+      return error;
+    };
+    std::cout << "Variants: " << variants.size() << " avg: " << timing.average() << " usec" << std::endl;
+    std::cout << "Max error fixed: " << maxError(fixed) << " jittered: " << maxError(jittered)
+              << " window of " << steps << ": " << maxError(short_jittered) << std::endl;
+    bool failed = maxError(jittered) >= maxError(fixed);
+    failed |= (steps > 1) && (maxError(short_jittered) >= maxError(fixed));
+    failed |= (steps == distance) && (maxError(jittered) * 10 > maxError(fixed));
+    return failed ? 1 : 0;
+  }
+
+  // Boxes get the same number of points at each level, the controller settles on the densest level within budget.
+  if (std::string(argv[1]) == "density")
+  {
+    Analyzer analyzer;
+    const Image image = makeFrame(3840, 2160, 3);
+    const Box bounds = analyzer.findBorders(image);
+    size_t failures = 0;
+    std::vector<std::vector<BoxSamples>> levels;
+    for (size_t level = 0; level < DensityController::Settings{}.levels; level++)
+    {
+      const size_t target = size_t{ 8 } << level;
+      levels.push_back(analyzer.makeBoxSamplesByCount(target, bounds));
+      size_t fewest = std::numeric_limits<size_t>::max();
+      size_t most = 0;
+      for (const auto& box : levels.back())
+      {
+        fewest = std::min(fewest, box.points.size());
+        most = std::max(most, box.points.size());
+      }
+      failures += (fewest * 2 < target) || (most > target * 2);
+      std::cout << "Level " << level << " target: " << target << " points: " << fewest << " - " << most << std::endl;
+    }
+
+    // Time the sampling of each level and pick the level for a budget between the third and fourth level.
+    std::vector<double> durations;
+    auto canvas = analyzer.makeCanvas();
+    for (const auto& samples : levels)
+    {
+      Measure timing;
+      for (size_t i = 0; i < 20; i++)
+      {
+        timing.start();
+        analyzer.sample(image, bounds, samples, canvas);
+        timing.stop();
+      }
+      durations.push_back(timing.average());
+    }
+    DensityController::Settings settings;
+    settings.budget_us = (durations[2] + durations[3]) / 2;
+    DensityController density{ settings, settings.levels - 1 };
+    for (size_t i = 0; i < 1000; i++)
+    {
+      density.update(durations[density.level()]);
+    }
+    std::cout << "Budget: " << settings.budget_us << " usec, level: " << density.level() << " average: "
+              << density.average() << " usec" << std::endl;
+    failures += density.level() != 2;
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // Sample two overlapping layouts in one pass and compare against sampling them separately.
+  if (std::string(argv[1]) == "plan")
+  {
+    const size_t count = (argc >= 3) ? std::atoi(argv[2]) : 100;
+    const Image image = makeFrame(1920, 1200, 3);
+    Analyzer rear;
+    Analyzer desk;
+    desk.setCellDepth(100, 300);
+    const Box bounds = rear.findBorders(image);
+    const auto rear_samples = rear.makeBoxSamples(15, bounds);
+    const auto desk_samples = desk.makeBoxSamples(15, bounds);
+
+    auto rear_expected = rear.makeCanvas();
+    auto desk_expected = desk.makeCanvas();
+    Measure separate;
+    for (size_t i = 0; i < count; i++)
+    {
+      separate.start();
+      rear.sample(image, bounds, rear_samples, rear_expected);
+      desk.sample(image, bounds, desk_samples, desk_expected);
+      separate.stop();
+    }
+
+    SamplePlan plan({ { bounds, &rear_samples }, { bounds, &desk_samples } });
+    auto rear_canvas = rear.makeCanvas();
+    auto desk_canvas = desk.makeCanvas();
+    Measure combined;
+    for (size_t i = 0; i < count; i++)
+    {
+      combined.start();
+      plan.sample(image, { &rear_canvas, &desk_canvas });
+      combined.stop();
+    }
+
+    size_t differences = 0;
+    for (size_t i = 0; i < rear_canvas.size(); i++)
+    {
+      differences += rear_canvas[i].toUint32() != rear_expected[i].toUint32();
+      differences += desk_canvas[i].toUint32() != desk_expected[i].toUint32();
+    }
+    std::cout << "Separate: " << plan.targetCount() << " reads, avg: " << separate.average() << " usec" << std::endl;
+    std::cout << "Combined: " << plan.pointCount() << " reads, avg: " << combined.average() << " usec" << std::endl;
+    std::cout << "Differences: " << differences << std::endl;
+    return differences ? 1 : 0;
+  }
+
+  // Run the rate controller over static and moving content, in simulated time.
+  if (std::string(argv[1]) == "rate")
+  {
+    RateController::Settings settings;
+    RateController rate{ settings, 60 };
+    Analyzer analyzer;
+    const Image image = makeFrame(640, 400, 0);
+    const Box bounds = analyzer.findBorders(image);
+    const auto samples = analyzer.makeBoxSamples(15, bounds);
+    auto canvas = analyzer.makeCanvas();
+    auto now = std::chrono::steady_clock::now();
+
+    // Advances time by one period of the current rate, sampling the provided frame.
+    auto step = [&](const Image& frame) {
+      now += std::chrono::microseconds(static_cast<size_t>(1e6 / rate.rate()));
+      analyzer.sample(frame, bounds, samples, canvas);
+      rate.update(canvas, now);
+    };
+
+    size_t failures = 0;
+    for (size_t i = 0; i < 200; i++)
+    {
+      step(image);
+    }
+    std::cout << "Static: " << rate.rate() << " hz" << std::endl;
+    failures += (rate.rate() != settings.min_hz);
+
+    // The gradient moves a pixel per frame, which is slow motion at the floor of the rate.
+    for (size_t i = 0; i < 20; i++)
+    {
+      step(makeFrame(640, 400, i));
+    }
+    std::cout << "Slow: " << rate.rate() << " hz, motion: " << rate.motion() << std::endl;
+    failures += (rate.rate() != settings.min_hz);
+
+    // Fast motion raises the rate to the maximum within a few frames.
+    for (size_t i = 0; i < 10; i++)
+    {
+      step(makeFrame(640, 400, i * 40));
+    }
+    std::cout << "Fast: " << rate.rate() << " hz, motion: " << rate.motion() << std::endl;
+    failures += (rate.rate() != settings.max_hz);
+
+    // Once static again the rate holds for a while before it drops.
+    step(image);
+    step(image);
+    const double held = rate.rate();
+    std::cout << "Held: " << held << " hz" << std::endl;
+    failures += (held != settings.max_hz);
+    return failures ? 1 : 0;
+  }
+
+  // Write synthetic frames to recordings and verify they read back identically.
+  if (std::string(argv[1]) == "roundtrip")
+  {
+    const size_t frames = (argc >= 3) ? std::atoi(argv[2]) : 100;
+    const size_t width = 320;
+    const size_t height = 200;
+    const std::string filename = "roundtrip.dlr";
+    size_t failures = 0;
+    for (const size_t border : { 0, 20 })
+    {
+      size_t frames_bytes = 0;
+      {
+        Recorder recorder(filename, border, 25);
+        for (size_t i = 0; i < frames; i++)
+        {
+          recorder.add(makeFrame(width, height, i), i * 16667, width * 2, height);
+        }
+        frames_bytes = recorder.bytes();
+        recorder.close();
+        std::cout << "Border " << border << ": " << recorder.bytes() << " bytes, "
+                  << double(recorder.bytes()) / (frames * width * height * 4) << " of raw" << std::endl;
+      }
+
+      // Sequential and random access.
+      Recording recording(filename);
+      failures += (recording.size() != frames);
+      for (size_t i = 0; i < recording.size(); i++)
+      {
+        failures += !sameContents(makeFrame(width, height, i), recording.read(i), border);
+      }
+      for (size_t i = 0; i < recording.size(); i += 7)
+      {
+        const size_t index = (i * 31) % recording.size();
+        failures += !sameContents(makeFrame(width, height, index), recording.read(index), border);
+      }
+      failures += (recording.timestamp(frames - 1) != (frames - 1) * 16667);
+      failures += (recording.getFullResolution() != Recording::Resolution(width * 2, height));
+
+      // A recording that was never closed is still readable.
+      {
+        std::ifstream in(filename, std::ios::binary);
+        std::vector<char> data(frames_bytes);
+        in.read(data.data(), data.size());
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size() - 10);  // The last frame is incomplete.
+      }
+      Recording unclosed(filename);
+      failures += (unclosed.size() != frames - 1);
+      failures += !sameContents(makeFrame(width, height, frames - 2), unclosed.read(frames - 2), border);
+
+      // Replaying as fast as possible returns every frame.
+      PixelSnifferReplay replay(filename, false);
+      size_t replayed = 0;
+      while (replay.grabContent())
+      {
+        replayed++;
+      }
+      failures += (replayed != frames - 1) || !replay.finished();
+    }
+    std::remove(filename.c_str());
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
   return 0;
 }
@@ -20,6 +20,11 @@
 #ifndef BOX_H
 #define BOX_H
 
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <tuple>
+
 /**
  * @brief A rectangle.
  */
@@ -63,6 +68,27 @@ struct Box
   {
     return y_max - y_min;
   }
+
+  /**
+   * @brief Return true if the two rectangles share any area, the maximum bounds are exclusive.
+   */
+  bool intersects(const Box& b) const
+  {
+    return (x_min < b.x_max) && (b.x_min < x_max) && (y_min < b.y_max) && (b.y_min < y_max);
+  }
+
+  /**
+   * @brief Return the area the two rectangles share, an empty box if they don't intersect.
+   */
+  Box intersection(const Box& b) const
+  {
+    if (!intersects(b))
+    {
+      return Box{};
+    }
+    return Box(std::max(x_min, b.x_min), std::min(x_max, b.x_max), std::max(y_min, b.y_min),
+               std::min(y_max, b.y_max));
+  }
 };
 
 #endif
\ No newline at end of file
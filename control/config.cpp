@@ -47,10 +47,51 @@ RegionConfig::operator std::string() const
   return ss.str();
 }
 
+ControllerConfig::operator std::string() const
+{
+  std::stringstream ss;
+  ss << "Controller: " << address << ":" << port << " leds " << first_led << " - " << first_led + led_count
+     << " at " << controller_offset << std::endl;
+  return ss.str();
+}
+
+StripConfig::operator std::string() const
+{
+  std::stringstream ss;
+  ss << "Strip: " << output << " at " << x_offset << ", " << y_offset << " size " << width << " x " << height
+     << std::endl;
+  return ss.str();
+}
+
 DisplayLightConfig::operator std::string() const
 {
   std::stringstream ss;
   ss << "Frame rate: " << frame_rate << std::endl;
+  ss << "Frame rate min: " << frame_rate_min << std::endl;
+  ss << "Frame rate max: " << frame_rate_max << std::endl;
+  ss << "Motion low: " << motion_low << std::endl;
+  ss << "Motion high: " << motion_high << std::endl;
+  ss << "Motion hold ms: " << motion_hold_ms << std::endl;
+  ss << "Cell depth: " << cell_depth_horizontal << " " << cell_depth_vertical << std::endl;
+  ss << "Sample distance: " << sample_distance << std::endl;
+  ss << "Sample budget us: " << sample_budget_us << std::endl;
+  ss << "Edge capture: " << edge_capture << std::endl;
+  ss << "Damage tracking: " << damage_tracking << std::endl;
+  ss << "Box change: " << box_change_probes << " " << box_refresh_frames << std::endl;
+  ss << "Sample jitter: " << sample_jitter << std::endl;
+  ss << "Skip identical ms: " << skip_identical_ms << std::endl;
+  ss << "Compact colors: " << compact_colors << std::endl;
+  ss << "Max frames in flight: " << max_frames_in_flight << std::endl;
+  ss << "Transition ms: " << transition_ms << std::endl;
+  ss << "Udp batch: " << udp_batch << std::endl;
+  for (const auto& controller : controllers)
+  {
+    ss << std::string(controller);
+  }
+  for (const auto& strip : strips)
+  {
+    ss << std::string(strip);
+  }
   for (const auto& region_config : configs)
   {
     ss << std::string(region_config);
@@ -141,15 +182,152 @@ DisplayLightConfig DisplayLightConfig::parse(const std::string& content)
       tl >> res.frame_rate;
       continue;
     }
+    if (element_name == "frame_rate_min:")
+    {
+      tl >> res.frame_rate_min;
+      continue;
+    }
+    if (element_name == "frame_rate_max:")
+    {
+      tl >> res.frame_rate_max;
+      continue;
+    }
+    if (element_name == "motion_low:")
+    {
+      tl >> res.motion_low;
+      continue;
+    }
+    if (element_name == "motion_high:")
+    {
+      tl >> res.motion_high;
+      continue;
+    }
+    if (element_name == "motion_hold_ms:")
+    {
+      tl >> res.motion_hold_ms;
+      continue;
+    }
+    if (element_name == "cell_depth:")
+    {
+      // cell_depth: <horizontal> <vertical>
+      tl >> res.cell_depth_horizontal >> res.cell_depth_vertical;
+      continue;
+    }
+    if (element_name == "sample_distance:")
+    {
+      tl >> res.sample_distance;
+      continue;
+    }
+    if (element_name == "sample_budget_us:")
+    {
+      tl >> res.sample_budget_us;
+      continue;
+    }
+    if (element_name == "edge_capture:")
+    {
+      tl >> res.edge_capture;
+      continue;
+    }
+    if (element_name == "damage_tracking:")
+    {
+      tl >> res.damage_tracking;
+      continue;
+    }
+    if (element_name == "box_change:")
+    {
+      // box_change: <probes per box> <refresh frames>
+      tl >> res.box_change_probes >> res.box_refresh_frames;
+      continue;
+    }
+    if (element_name == "sample_jitter:")
+    {
+      tl >> res.sample_jitter;
+      continue;
+    }
+    if (element_name == "skip_identical_ms:")
+    {
+      tl >> res.skip_identical_ms;
+      continue;
+    }
+    if (element_name == "compact_colors:")
+    {
+      tl >> res.compact_colors;
+      continue;
+    }
+    if (element_name == "max_frames_in_flight:")
+    {
+      tl >> res.max_frames_in_flight;
+      continue;
+    }
+    if (element_name == "transition_ms:")
+    {
+      tl >> res.transition_ms;
+      continue;
+    }
+    if (element_name == "controller:")
+    {
+      // controller: <address> <port> <first_led> <led_count> [controller_offset]
+      ControllerConfig controller;
+      tl >> controller.address >> controller.port >> controller.first_led >> controller.led_count;
+      if (!tl)
+      {
+        std::cerr << "Incomplete controller line: \"" << line << "\"" << std::endl;
+        continue;
+      }
+      tl >> controller.controller_offset;
+      res.controllers.push_back(controller);
+      continue;
+    }
+    if (element_name == "udp_batch:")
+    {
+      tl >> res.udp_batch;
+      continue;
+    }
+    if (element_name == "strip:")
+    {
+      // strip: <output> <x_offset> <y_offset> <width> <height>
+      StripConfig strip;
+      tl >> strip.output >> strip.x_offset >> strip.y_offset >> strip.width >> strip.height;
+      if (!tl)
+      {
+        std::cerr << "Incomplete strip line: \"" << line << "\"" << std::endl;
+        continue;
+      }
+      res.strips.push_back(strip);
+      continue;
+    }
     std::cerr << "Unexpected config line: \"" << line << "\"" << std::endl;
   }
   res.configs.push_back(current);
 
   res.configs.push_back(RegionConfig{});
 
+  res.resolveConflicts();
   return res;
 }
 
+void DisplayLightConfig::resolveConflicts()
+{
+  // The sampling modes exclude each other, the first one that is set applies.
+  if (damage_tracking && (box_change_probes || (sample_jitter > 1)))
+  {
+    std::cerr << "damage_tracking ignores box_change and sample_jitter, they are disabled." << std::endl;
+    box_change_probes = 0;
+    sample_jitter = 0;
+  }
+  if (box_change_probes && (sample_jitter > 1))
+  {
+    std::cerr << "box_change ignores sample_jitter, it is disabled." << std::endl;
+    sample_jitter = 0;
+  }
+  if ((sample_jitter > 1) && sample_budget_us)
+  {
+    // The variants are made at the sample distance, the density controller has nothing to adjust.
+    std::cerr << "sample_jitter samples at sample_distance, sample_budget_us is disabled." << std::endl;
+    sample_budget_us = 0;
+  }
+}
+
 DisplayLightConfig DisplayLightConfig::load(const std::string& filename)
 {
   std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
@@ -51,6 +51,34 @@ struct RegionConfig
 };
 
 
+/**
+ * @brief A networked led controller and the range of leds it drives.
+ */
+struct ControllerConfig
+{
+  std::string address;                 //!< Address of the controller.
+  std::uint16_t port{ 4048 };          //!< UDP port of the controller.
+  std::size_t first_led{ 0 };          //!< First led sent to the controller.
+  std::size_t led_count{ 0 };          //!< Number of leds sent to the controller.
+  std::size_t controller_offset{ 0 };  //!< Pixel on the controller the first led is written to.
+
+  operator std::string() const;
+};
+
+/**
+ * @brief A led strip with its own output, representing an area of the desktop. Used to drive one strip per monitor.
+ */
+struct StripConfig
+{
+  std::string output;         //!< The output of the strip, as accepted by Lights::connect.
+  std::size_t x_offset{ 0 };  //!< Left of the area on the desktop.
+  std::size_t y_offset{ 0 };  //!< Top of the area on the desktop.
+  std::size_t width{ 0 };     //!< Width of the area.
+  std::size_t height{ 0 };    //!< Height of the area.
+
+  operator std::string() const;
+};
+
 struct DisplayLightConfig
 {
 
@@ -58,8 +86,39 @@ struct DisplayLightConfig
 
   double frame_rate{ 60 };
 
+  double frame_rate_min{ 0 };     //!< Lowest rate for static content, 0 disables adapting the rate to the motion.
+  double frame_rate_max{ 120 };   //!< Highest rate for fast motion.
+  double motion_low{ 20 };        //!< Motion below which the rate is lowered, channel levels per second.
+  double motion_high{ 150 };      //!< Motion above which the rate is raised, channel levels per second.
+  double motion_hold_ms{ 1000 };  //!< Duration the motion has to stay low before lowering the rate.
+
+  std::size_t cell_depth_horizontal{ 200 };  //!< Depth the cells of the left and right sides protrude into the screen.
+  std::size_t cell_depth_vertical{ 200 };    //!< Depth the cells of the top and bottom sides protrude into the screen.
+  std::size_t sample_distance{ 15 };         //!< Distance between the sample points in each box, in pixels.
+  double sample_budget_us{ 0 };              //!< Time sampling a frame may take, 0 uses the sample distance instead.
+
+  bool edge_capture{ false };             //!< Only capture the regions of the screen the analysis reads.
+  bool damage_tracking{ false };          //!< Only capture and sample the screen where it changed.
+  std::size_t box_change_probes{ 0 };     //!< Probes per box to find the boxes that changed, 0 samples all boxes.
+  std::size_t box_refresh_frames{ 60 };   //!< Frames in which each box is sampled at least once, with box_change.
+  std::size_t sample_jitter{ 0 };         //!< Grid offsets averaged over as many frames, 15 lags 250 ms at 60 Hz.
+  std::size_t skip_identical_ms{ 0 };     //!< Longest an unchanged frame skips the analysis, 0 disables it.
+  bool compact_colors{ false };           //!< Send colors to the leds in the compact RGB565 encoding.
+  std::size_t max_frames_in_flight{ 0 };  //!< Frames that may be unacknowledged by the leds, 0 disables flow control.
+  std::size_t transition_ms{ 0 };         //!< Duration of the leds' transition to each new frame, 0 disables it.
+
+  std::vector<ControllerConfig> controllers;  //!< Controllers used by the udp output.
+  std::size_t udp_batch{ 0 };                 //!< Datagrams per sendmmsg call, 0 sends each frame in one call.
+
+  std::vector<StripConfig> strips;  //!< Strips driven from one capture, each with its own output.
+
   RegionConfig getApplicable(std::size_t width, std::size_t height) const;
 
+  /**
+   * @brief Disable the keys of sampling modes that can't be combined with another one that is set, with a warning.
+   */
+  void resolveConflicts();
+
   operator std::string() const;
 
   static DisplayLightConfig parse(const std::string& content);
@@ -0,0 +1,140 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "configWatcher.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ConfigWatcher::ConfigWatcher(const std::string& filename) : filename_(filename)
+{
+#ifdef __linux__
+  // Watch the directory, editors often write a new file and rename it over the old one.
+  const size_t slash = filename_.rfind('/');
+  const std::string directory = (slash == std::string::npos) ? "." : filename_.substr(0, slash + 1);
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ == -1)
+  {
+    throw std::runtime_error("Failed to initialise inotify.");
+  }
+  if (inotify_add_watch(fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1)
+  {
+    close(fd_);
+    throw std::runtime_error("Failed to watch " + directory);
+  }
+  thread_ = std::thread([this]() { run(); });
+#else
+  throw std::runtime_error("Watching the config is not supported on this platform.");
+#endif
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+  running_ = false;
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+#ifdef __linux__
+  if (fd_ != -1)
+  {
+    close(fd_);
+  }
+#endif
+}
+
+bool ConfigWatcher::poll(DisplayLightConfig& config)
+{
+  if (!pending_.load(std::memory_order_acquire))
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  config = config_;
+  pending_ = false;
+  return true;
+}
+
+size_t ConfigWatcher::reloads() const
+{
+  return reloads_;
+}
+
+void ConfigWatcher::run()
+{
+#ifdef __linux__
+  const size_t slash = filename_.rfind('/');
+  const std::string name = (slash == std::string::npos) ? filename_ : filename_.substr(slash + 1);
+  alignas(inotify_event) char buffer[4096];
+  while (running_)
+  {
+    // Wake up regularly to check whether to stop.
+    pollfd fds{ fd_, POLLIN, 0 };
+    if (::poll(&fds, 1, 250) <= 0)
+    {
+      continue;
+    }
+
+    // Check whether any of the events concern the config file.
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(fd_, buffer, sizeof(buffer))) > 0)
+    {
+      for (char* p = buffer; p < buffer + length;)
+      {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+        changed |= (event->len != 0) && (name == event->name);
+        p += sizeof(inotify_event) + event->len;
+      }
+    }
+    if (!changed)
+    {
+      continue;
+    }
+
+    // Saving often produces several events, let them settle before parsing.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    while (read(fd_, buffer, sizeof(buffer)) > 0)
+    {
+    }
+    if (!std::ifstream(filename_).good())
+    {
+      continue;  // Removed, wait for it to be written again.
+    }
+    try
+    {
+      auto config = DisplayLightConfig::load(filename_);
+      std::lock_guard<std::mutex> lock(mutex_);
+      config_ = std::move(config);
+      reloads_++;
+      pending_.store(true, std::memory_order_release);
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "Failed to load " << filename_ << ": " << e.what() << std::endl;
+    }
+  }
+#endif
+}
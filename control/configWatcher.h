@@ -0,0 +1,73 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CONFIG_WATCHER_H
+#define CONFIG_WATCHER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "config.h"
+
+/**
+ * @brief Watches a config file and parses it again when it changes, this happens on a thread of its own. The frame
+ *        loop picks up the new config through poll(), which only checks an atomic flag if nothing changed. The
+ *        directory holding the file is watched, such that editors that replace the file instead of writing it are
+ *        handled. Only supported on Linux, where inotify is used.
+ */
+class ConfigWatcher
+{
+public:
+  /**
+   * @brief Start watching the file.
+   * @throws std::runtime_error if the file can't be watched.
+   */
+  ConfigWatcher(const std::string& filename);
+  ~ConfigWatcher();
+
+  /**
+   * @brief Retrieve the config if the file changed since the last call.
+   * @param config Is assigned the new config if it changed.
+   * @return True if the config changed.
+   */
+  bool poll(DisplayLightConfig& config);
+
+  /**
+   * @brief Return the number of times the config was parsed again.
+   */
+  size_t reloads() const;
+
+private:
+  std::string filename_;                //!< The file that is watched.
+  int fd_{ -1 };                        //!< The inotify instance.
+  std::thread thread_;                  //!< Thread waiting for changes and parsing the file.
+  std::atomic<bool> running_{ true };   //!< Cleared to stop the thread.
+  std::atomic<bool> pending_{ false };  //!< Set if a new config waits to be picked up.
+  std::atomic<size_t> reloads_{ 0 };    //!< Number of times the config was parsed again.
+  std::mutex mutex_;                    //!< Protects the new config.
+  DisplayLightConfig config_;           //!< The new config.
+
+  /**
+   * @brief Wait for changes to the file until stopped, parsing the file after each change.
+   */
+  void run();
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "controlSocket.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+/**
+ * @brief A connection to the control socket, reads commands line by line and writes the responses.
+ */
+class ControlSocket::Session : public std::enable_shared_from_this<ControlSocket::Session>
+{
+public:
+  Session(ControlSocket& control) : control_(control), socket_(control.io_)
+  {
+  }
+
+  boost::asio::local::stream_protocol::socket& socket()
+  {
+    return socket_;
+  }
+
+  /**
+   * @brief Read the next command, process it and write the response.
+   */
+  void read()
+  {
+    auto self = shared_from_this();
+    boost::asio::async_read_until(socket_, input_, '\n', [self](const boost::system::error_code& ec, std::size_t) {
+      if (ec == boost::asio::error::not_found)
+      {
+        // The line doesn't fit the buffer, answer and end the session.
+        self->response_ = "error: line longer than " + std::to_string(max_line_length) + " bytes\n";
+        boost::asio::async_write(self->socket_, boost::asio::buffer(self->response_),
+                                 [self](const boost::system::error_code&, std::size_t) {});
+        return;
+      }
+      if (ec)
+      {
+        return;  // Closed by the client, the session ends here.
+      }
+      std::istream stream(&self->input_);
+      std::string line;
+      std::getline(stream, line);
+      self->response_ = self->control_.process(line);
+      boost::asio::async_write(self->socket_, boost::asio::buffer(self->response_),
+                               [self](const boost::system::error_code& ec, std::size_t) {
+                                 if (!ec)
+                                 {
+                                   self->read();
+                                 }
+                               });
+    });
+  }
+
+private:
+  static const std::size_t max_line_length = 4096;  //!< Limit of a received line, a client can't grow the buffer.
+
+  ControlSocket& control_;                              //!< The control socket this session belongs to.
+  boost::asio::local::stream_protocol::socket socket_;  //!< The connection.
+  boost::asio::streambuf input_{ max_line_length };     //!< Received data.
+  std::string response_;                                //!< Response that is being written.
+};
+
+ControlSocket::ControlSocket(const std::string& path, const Metrics& metrics, Tuning& tuning,
+                             std::vector<const Lights*> lights)
+  : path_(path), metrics_(metrics), tuning_(tuning), lights_(std::move(lights)), acceptor_(io_)
+{
+  std::remove(path_.c_str());
+  try
+  {
+    boost::asio::local::stream_protocol::endpoint endpoint(path_);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+  }
+  catch (const boost::system::system_error& e)
+  {
+    throw std::runtime_error("Failed to create control socket " + path_ + ": " + e.what());
+  }
+  accept();
+  thread_ = std::thread([this]() { io_.run(); });
+}
+
+ControlSocket::~ControlSocket()
+{
+  io_.stop();
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+  std::remove(path_.c_str());
+}
+
+void ControlSocket::accept()
+{
+  auto session = std::make_shared<Session>(*this);
+  acceptor_.async_accept(session->socket(), [this, session](const boost::system::error_code& ec) {
+    if (!ec)
+    {
+      session->read();
+    }
+    accept();
+  });
+}
+
+std::string ControlSocket::process(const std::string& line)
+{
+  std::stringstream tl(line);
+  std::string command;
+  tl >> command;
+  std::stringstream ss;
+
+  if (command == "stats")
+  {
+    ss << "frames " << metrics_.frames << "\n";
+    ss << "frames_skipped " << metrics_.frames_skipped << "\n";
+    ss << "skip_ratio " << metrics_.skipRatio() << "\n";
+    ss << "capture_failures " << metrics_.capture_failures << "\n";
+    ss << "bounds_changes " << metrics_.bounds_changes << "\n";
+    ss << "boxes_sampled " << metrics_.boxes_sampled_last << "\n";
+    ss << "samples_per_box " << metrics_.samples_per_box << "\n";
+    ss << "plan_rebuilds " << metrics_.plan_rebuilds << "\n";
+    ss << "rate_hz " << metrics_.rate << "\n";
+    for (size_t i = 0; i < Metrics::STAGE_COUNT; i++)
+    {
+      const auto count = metrics_.stages[i].count.load();
+      const double average = count ? double(metrics_.stages[i].total_us) / count : 0.0;
+      ss << "stage_" << Metrics::stageName(i) << "_avg_us " << average << "\n";
+    }
+    for (size_t i = 0; i < lights_.size(); i++)
+    {
+      const auto stats = lights_[i]->getStatistics();
+      ss << "output" << i << "_frames_written " << stats.frames_written << "\n";
+      ss << "output" << i << "_frames_dropped " << stats.frames_dropped << "\n";
+      ss << "output" << i << "_frames_unchanged " << stats.frames_unchanged << "\n";
+      ss << "output" << i << "_write_errors " << stats.write_errors << "\n";
+      ss << "output" << i << "_bytes_written " << stats.bytes_written << "\n";
+      ss << "output" << i << "_write_latency_us " << stats.write_latency_us << "\n";
+    }
+    ss << "ok\n";
+    return ss.str();
+  }
+
+  if (command == "set")
+  {
+    std::string parameter;
+    double value = -1;
+    tl >> parameter >> value;
+    if (!tl || (value < 0))
+    {
+      return "error: expected set <parameter> <value>, with a positive value\n";
+    }
+    if ((parameter == "brightness") && (value <= 1.0))
+    {
+      tuning_.brightness = value;
+    }
+    else if ((parameter == "frame_rate") && (value > 0))
+    {
+      tuning_.frame_rate = value;
+    }
+    else if ((parameter == "sample_distance") && (value >= 1))
+    {
+      tuning_.sample_distance = static_cast<int64_t>(value);
+    }
+    else
+    {
+      return "error: unknown parameter or value out of range: " + parameter + "\n";
+    }
+    return "ok\n";
+  }
+
+  if (command == "help")
+  {
+    ss << "stats\n";
+    ss << "set brightness <factor>\n";
+    ss << "set frame_rate <hz>          fixed rate, stops adapting the rate to the motion\n";
+    ss << "set sample_distance <pixels>\n";
+    ss << "a config reload discards the frame_rate and sample_distance set, the brightness is kept\n";
+    ss << "ok\n";
+    return ss.str();
+  }
+  return "error: unknown command: " + command + "\n";
+}
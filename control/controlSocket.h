@@ -0,0 +1,107 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CONTROL_SOCKET_H
+#define CONTROL_SOCKET_H
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lights.h"
+#include "metrics.h"
+
+/**
+ * @brief Parameters that are changed through the control socket and picked up by the frame loop. Each holds a negative
+ *        value while there is no change, the frame loop takes a change by exchanging it with that value.
+ */
+struct Tuning
+{
+  std::atomic<double> brightness{ -1 };        //!< Requested limit factor of the lights.
+  std::atomic<double> frame_rate{ -1 };        //!< Requested frame rate, in hz.
+  std::atomic<int64_t> sample_distance{ -1 };  //!< Requested distance between sample points, in pixels.
+
+  /**
+   * @brief Take the requested change of a parameter.
+   * @return True if there was a change, it is assigned to value.
+   */
+  template <typename T, typename V>
+  static bool take(std::atomic<T>& parameter, V& value)
+  {
+    if (parameter.load(std::memory_order_relaxed) < 0)
+    {
+      return false;
+    }
+    value = static_cast<V>(parameter.exchange(-1));
+    return true;
+  }
+};
+
+/**
+ * @brief Unix domain socket to query the statistics of a running instance and change parameters. It is served from a
+ *        thread of its own, the frame loop is only involved through the atomics in Metrics and Tuning. Each line sent
+ *        to the socket is a command, the response ends with a line holding "ok" or starting with "error:". The frame
+ *        rate and sample distance set through the socket last until the config is reloaded, the reload applies the
+ *        values from the file. The config has no brightness, the brightness set lasts until it is set again.
+ *
+ *   stats                           The metrics of the frame loop and the statistics of each output.
+ *   set brightness <factor>         Multiply all colors by this factor, between 0.0 and 1.0.
+ *   set frame_rate <hz>             Run the frame loop at this rate, this stops adapting the rate to the motion.
+ *   set sample_distance <pixels>    Change the distance between the sample points in each box.
+ *   help                            List the commands.
+ */
+class ControlSocket
+{
+public:
+  /**
+   * @brief Create the socket at the provided path and start serving it.
+   * @param path The path of the socket, an existing file at this path is removed.
+   * @param metrics The metrics reported by stats.
+   * @param tuning The parameters changed by set.
+   * @param lights The lights of which the statistics are reported.
+   * @throws std::runtime_error if the socket can't be created.
+   */
+  ControlSocket(const std::string& path, const Metrics& metrics, Tuning& tuning, std::vector<const Lights*> lights);
+  ~ControlSocket();
+
+  /**
+   * @brief Process a single command and return the response, this is what the socket does for each line.
+   */
+  std::string process(const std::string& line);
+
+private:
+  class Session;
+
+  std::string path_;                                        //!< Path of the socket.
+  const Metrics& metrics_;                                  //!< The metrics reported by stats.
+  Tuning& tuning_;                                          //!< The parameters changed by set.
+  std::vector<const Lights*> lights_;                       //!< The lights of which the statistics are reported.
+  boost::asio::io_service io_;                              //!< IO service running on the thread.
+  boost::asio::local::stream_protocol::acceptor acceptor_;  //!< Accepts the connections.
+  std::thread thread_;                                      //!< Thread serving the socket.
+
+  /**
+   * @brief Accept the next connection.
+   */
+  void accept();
+};
+
+#endif
@@ -0,0 +1,223 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "emulator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+constexpr const size_t DeviceEmulator::max_led_count;
+constexpr const uint32_t DeviceEmulator::interpolation_interval_us;
+
+DeviceEmulator::DeviceEmulator(size_t led_count, const Config& config)
+  : config_(config), shown_(led_count, RGB{ 0, 0, 0 })
+{
+  if (led_count > max_led_count)
+  {
+    throw std::runtime_error("The firmware supports at most " + std::to_string(max_led_count) + " leds, got " +
+                             std::to_string(led_count) + ".");
+  }
+  computeGammaTables();
+  partial_.reserve(sizeof(Message));
+}
+
+Config DeviceEmulator::defaultConfig()
+{
+  // Same as the defaults in the firmware's setup().
+  Config config;
+  config.decay_time_delay_ms = 1000;
+  config.decay_interval_us = 1000;
+  config.decay_amount = 1;
+  config.gamma_r = 1.0;
+  config.gamma_g = 1.3;
+  config.gamma_b = 1.6;
+  return config;
+}
+
+void DeviceEmulator::computeGammaTables()
+{
+  auto create = [](uint8_t* table, float gamma) {
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      table[i] = std::pow(static_cast<float>(i) / 256.0, gamma) * 256.0 + 0.5;
+    }
+  };
+  create(r_gamma_, config_.gamma_r);
+  create(g_gamma_, config_.gamma_g);
+  create(b_gamma_, config_.gamma_b);
+}
+
+void DeviceEmulator::showInterpolated()
+{
+  for (size_t i = 0; i < shown_.size(); i++)
+  {
+    const auto& c = interpolator_.current(i);
+    shown_[i] = RGB{ r_gamma_[c.R], g_gamma_[c.G], b_gamma_[c.B] };
+  }
+}
+
+void DeviceEmulator::show(const Message& msg, uint8_t settings)
+{
+  if (settings & ColorData::settings_show_after)
+  {
+    interpolator_.commit(now_us_, static_cast<uint32_t>(msg.transition_ms) * 1000);
+    interpolator_.update(now_us_);
+    showInterpolated();
+    since_interpolation_us_ = 0;
+    show_count_++;
+    if (settings & ColorData::settings_ack)
+    {
+      Ack ack;
+      ack.type = ACK;
+      ack.sequence = msg.sequence;
+      const uint8_t* data = reinterpret_cast<const uint8_t*>(&ack);
+      response_.insert(response_.end(), data, data + sizeof(ack));
+    }
+  }
+}
+
+void DeviceEmulator::advance(uint32_t duration_us)
+{
+  // Step through time like the firmware's loop does, at the finest interval of the decay and the interpolation.
+  const uint32_t tick_us = config_.decay_interval_us ?
+                               std::min<uint32_t>(config_.decay_interval_us, interpolation_interval_us) :
+                               interpolation_interval_us;
+  while (duration_us)
+  {
+    const uint32_t step = std::min(duration_us, tick_us);
+    duration_us -= step;
+    now_us_ += step;
+    since_event_us_ += step;
+    since_decay_us_ += step;
+    since_interpolation_us_ += step;
+
+    // The decay delay counts from the end of the transition.
+    if (!interpolator_.done())
+    {
+      since_event_us_ = 0;
+    }
+    if ((config_.decay_time_delay_ms != 0) && (since_event_us_ >= config_.decay_time_delay_ms * 1000ull) &&
+        (since_decay_us_ >= config_.decay_interval_us))
+    {
+      interpolator_.decay(config_.decay_amount);
+      showInterpolated();
+      since_decay_us_ = 0;
+    }
+
+    if (since_interpolation_us_ >= interpolation_interval_us)
+    {
+      since_interpolation_us_ = 0;
+      if (interpolator_.update(now_us_))
+      {
+        showInterpolated();
+      }
+    }
+  }
+}
+
+void DeviceEmulator::process(const Message& msg)
+{
+  message_count_++;
+  since_event_us_ = 0;
+  switch (msg.type)
+  {
+    case NOP:
+      break;
+
+    case CONFIG:
+      config_ = msg.config;
+      computeGammaTables();
+      break;
+
+    case COLOR:
+      if (msg.color.settings & msg.color.settings_set_all)
+      {
+        const RGB& c = msg.color.color[0];
+        for (size_t i = 0; i < max_led_count; i++)
+        {
+          interpolator_.setNext(i, c.R, c.G, c.B);
+        }
+      }
+      else
+      {
+        // The interpolator ignores leds beyond the strip.
+        for (uint16_t i = 0; i < ColorData::leds_per_message; i++)
+        {
+          const RGB& c = msg.color.color[i];
+          interpolator_.setNext(i + msg.color.offset, c.R, c.G, c.B);
+        }
+      }
+      show(msg, msg.color.settings);
+      break;
+
+    case COLOR_RGB565:
+      for (uint16_t i = 0; i < ColorData565::leds_per_message; i++)
+      {
+        const RGB c = ColorData565::decode(msg.color565.color[i]);
+        interpolator_.setNext(i + msg.color565.offset, c.R, c.G, c.B);
+      }
+      show(msg, msg.color565.settings);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void DeviceEmulator::feed(const uint8_t* data, size_t length)
+{
+  while (length)
+  {
+    const size_t take = std::min(length, sizeof(Message) - partial_.size());
+    partial_.insert(partial_.end(), data, data + take);
+    data += take;
+    length -= take;
+    if (partial_.size() == sizeof(Message))
+    {
+      Message msg;
+      std::memcpy(&msg, partial_.data(), sizeof(msg));
+      partial_.clear();
+      process(msg);
+    }
+  }
+}
+
+std::vector<uint8_t> DeviceEmulator::takeResponse()
+{
+  std::vector<uint8_t> res;
+  std::swap(res, response_);
+  return res;
+}
+
+const std::vector<RGB>& DeviceEmulator::shown() const
+{
+  return shown_;
+}
+
+size_t DeviceEmulator::showCount() const
+{
+  return show_count_;
+}
+
+size_t DeviceEmulator::messageCount() const
+{
+  return message_count_;
+}
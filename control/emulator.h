@@ -0,0 +1,122 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "../firmware/messages.h"
+#include "../firmware/interpolator.h"
+
+/**
+ * @brief Host side stand-in for the firmware, it processes messages exactly like processCommand in firmware/main.ino
+ *        does. This allows verifying that the state of the device matches what the host intended to send. Received
+ *        colors go through the same interpolator as on the firmware, time only passes when advance() is called.
+ */
+class DeviceEmulator
+{
+public:
+  /**
+   * @brief Create an emulator for a strip with the provided number of leds, using the provided config. Throws if the
+   *        strip is longer than the firmware supports.
+   */
+  DeviceEmulator(size_t led_count, const Config& config = defaultConfig());
+
+  /**
+   * @brief Return the config the firmware starts with.
+   */
+  static Config defaultConfig();
+
+  /**
+   * @brief Process a single message, mirrors processCommand in the firmware.
+   */
+  void process(const Message& msg);
+
+  /**
+   * @brief Process a stream of bytes as received from the serial port, partial messages are retained until the next
+   *        call completes them.
+   */
+  void feed(const uint8_t* data, size_t length);
+
+  /**
+   * @brief Let time pass, mirrors the firmware's loop: transitions progress and the leds decay once no message was
+   *        received for the configured delay.
+   * @param duration_us The time that passes in microseconds.
+   */
+  void advance(uint32_t duration_us);
+
+  /**
+   * @brief Return the bytes the device sent back to the host since the last call, the acknowledgements.
+   */
+  std::vector<uint8_t> takeResponse();
+
+  /**
+   * @brief Return the colors that were on the leds at the last show, these are gamma corrected.
+   */
+  const std::vector<RGB>& shown() const;
+
+  /**
+   * @brief Return the number of keyframes that were shown.
+   */
+  size_t showCount() const;
+
+  /**
+   * @brief Return the number of messages that have been processed.
+   */
+  size_t messageCount() const;
+
+  static constexpr const size_t max_led_count{ 228 };  //!< Same as ledsInStrip in the firmware.
+
+private:
+  static constexpr const uint32_t interpolation_interval_us{ 5000 };  //!< Same as in the firmware.
+
+  Config config_;                             //!< Currently active config.
+  Interpolator<max_led_count> interpolator_;  //!< Received keyframes and the transition towards them, before gamma.
+  std::vector<RGB> shown_;                    //!< The colors that are shown on the leds.
+  uint32_t now_us_{ 0 };                      //!< The emulated microsecond clock.
+  uint64_t since_event_us_{ 0 };              //!< Time since the last message was received.
+  uint32_t since_decay_us_{ 0 };              //!< Time since the last decay step.
+  uint32_t since_interpolation_us_{ 0 };      //!< Time since the last interpolation output.
+  size_t show_count_{ 0 };                    //!< Number of keyframes shown.
+  size_t message_count_{ 0 };                 //!< Number of messages processed.
+  std::vector<uint8_t> partial_;              //!< Bytes of an incomplete message.
+  std::vector<uint8_t> response_;             //!< Bytes sent back to the host.
+  uint8_t r_gamma_[256];                      //!< Gamma table for red.
+  uint8_t g_gamma_[256];                      //!< Gamma table for green.
+  uint8_t b_gamma_[256];                      //!< Gamma table for blue.
+
+  /**
+   * @brief Compute the gamma tables from the config.
+   */
+  void computeGammaTables();
+
+  /**
+   * @brief Write the interpolator's current colors to the leds with gamma correction, mirrors showInterpolated.
+   */
+  void showInterpolated();
+
+  /**
+   * @brief Commit the keyframe and send an acknowledgement if requested, mirrors showKeyframe and sendAck.
+   */
+  void show(const Message& msg, uint8_t settings);
+};
+
+#endif
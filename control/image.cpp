@@ -18,6 +18,7 @@
   SOFTWARE.
 */
 #include "image.h"
+#include <algorithm>
 #include <fstream>
 #include <memory>
 #include <sstream>
@@ -54,6 +55,26 @@ void Image::setPixel(size_t x, size_t y, uint32_t color)
   map_[y][x] = color;
 }
 
+void Image::copyRow(size_t y, uint32_t* pixels) const
+{
+  std::copy(map_[y].begin(), map_[y].end(), pixels);
+}
+
+void Image::assign(const Image& image)
+{
+  width_ = image.getWidth();
+  height_ = image.getHeight();
+  map_.resize(height_);
+  for (auto& row : map_)
+  {
+    row.resize(width_);
+  }
+  for (size_t y = 0; y < height_; y++)
+  {
+    image.copyRow(y, map_[y].data());
+  }
+}
+
 void Image::hLine(size_t y, uint32_t color)
 {
   for (size_t i = 0; i < getWidth(); i++)
@@ -70,6 +91,57 @@ void Image::vLine(size_t x, uint32_t color)
   }
 }
 
+ImageView::ImageView(Ptr image, const Box& area) : image_(std::move(image)), area_(area)
+{
+  width_ = area.width();
+  height_ = area.height();
+}
+
+void ImageView::convertToBitmap()
+{
+  if (shared_)
+  {
+    Bitmap map(height_, std::vector<uint32_t>(width_, 0));
+    for (size_t y = 0; y < height_; y++)
+    {
+      for (size_t x = 0; x < width_; x++)
+      {
+        map[y][x] = pixel(x, y);
+      }
+    }
+    map_ = std::move(map);
+    shared_ = false;
+  }
+}
+
+uint32_t ImageView::pixel(size_t x, size_t y) const
+{
+  if (shared_)
+  {
+    return image_->pixel(x + area_.x_min, y + area_.y_min);
+  }
+  return map_[y][x];
+}
+
+void ImageView::setPixel(size_t x, size_t y, uint32_t color)
+{
+  convertToBitmap();
+  map_[y][x] = color;
+}
+
+void ImageView::copyRow(size_t y, uint32_t* pixels) const
+{
+  if (!shared_)
+  {
+    Image::copyRow(y, pixels);
+    return;
+  }
+  for (size_t x = 0; x < width_; x++)
+  {
+    pixels[x] = image_->pixel(x + area_.x_min, y + area_.y_min);
+  }
+}
+
 std::string Image::imageToPPM() const
 {
   std::stringstream ss;
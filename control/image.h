@@ -23,6 +23,7 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include "box.h"
 
 /**
  * @brief Base class for the images, this is always backed by a vector of vectors. Basically it is
@@ -86,6 +87,17 @@ public:
    */
   virtual void vLine(size_t x, uint32_t color);
 
+  /**
+   * @brief Copy a row of pixels into the provided buffer of getWidth() pixels. Format is 0x00RRGGBB
+   */
+  virtual void copyRow(size_t y, uint32_t* pixels) const;
+
+  /**
+   * @brief Make this bitmap backed image a copy of another image, the bitmap is only reallocated if the dimensions
+   *        differ.
+   */
+  void assign(const Image& image);
+
   /**
    * @brief Get the ppm presentation of the data in this image.
    */
@@ -109,4 +121,42 @@ public:
   static Image readContents(const std::string& filename);
 };
 
+/**
+ * @brief View on an area of another image, the pixels are read from that image without copying them. Coordinates are
+ *        relative to the area. Writing converts the view to a bitmap holding a copy of the area.
+ */
+class ImageView : public Image
+{
+public:
+  /**
+   * @brief Create the view, the area must lie within the image.
+   */
+  ImageView(Ptr image, const Box& area);
+
+  /**
+   * @brief Copy the area into a bitmap, the view no longer reads from the image.
+   */
+  void convertToBitmap();
+
+  /**
+   * @brief Return the value of a pixel in the area. Format is 0x00RRGGBB
+   */
+  uint32_t pixel(size_t x, size_t y) const;
+
+  /**
+   * @brief Writes a certain value to a position, this converts the view to a bitmap first.
+   */
+  void setPixel(size_t x, size_t y, uint32_t color);
+
+  /**
+   * @brief Copy a row of the area into the provided buffer.
+   */
+  void copyRow(size_t y, uint32_t* pixels) const;
+
+private:
+  Ptr image_;            //!< The image the area lies in.
+  Box area_;             //!< The area of the image the view represents.
+  bool shared_{ true };  //!< True if the pixels are read from the image, false if the bitmap is used.
+};
+
 #endif
@@ -98,3 +98,18 @@ uint32_t ImageWin::pixel(size_t x, size_t y) const
     return Image::pixel(x, y);
   }
 }
+
+void ImageWin::copyRow(size_t y, uint32_t* pixels) const
+{
+  if (!shared_memory_)
+  {
+    Image::copyRow(y, pixels);
+    return;
+  }
+  const uint8_t* row = reinterpret_cast<const uint8_t*>(mapped_.pData) + y * mapped_.RowPitch;
+  const uint8_t stride = (mapped_.RowPitch / getWidth());
+  for (size_t x = 0; x < getWidth(); x++)
+  {
+    pixels[x] = (*reinterpret_cast<const uint32_t*>(row + x * stride)) & 0x00FFFFFF;
+  }
+}
@@ -60,6 +60,11 @@ public:
    * @brief Return the value of a pixel on the ImageWin. Format is 0x00RRGGBB
    */
   uint32_t pixel(size_t x, size_t y) const;
+
+  /**
+   * @brief Copy a row of the ImageWin into the provided buffer.
+   */
+  void copyRow(size_t y, uint32_t* pixels) const;
 };
 
 #endif
\ No newline at end of file
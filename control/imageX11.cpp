@@ -18,6 +18,7 @@
   SOFTWARE.
 */
 #include "imageX11.h"
+#include <algorithm>
 #include <fstream>
 #include <memory>
 #include <sstream>
@@ -71,3 +72,89 @@ uint32_t ImageX11::pixel(size_t x, size_t y) const
     return map_[y][x];
   }
 }
+
+void ImageX11::copyRow(size_t y, uint32_t* pixels) const
+{
+  if (!shared_memory_)
+  {
+    Image::copyRow(y, pixels);
+    return;
+  }
+  const uint8_t* row = reinterpret_cast<const uint8_t*>(image_->data) + y * image_->bytes_per_line;
+  const uint8_t stride = image_->bits_per_pixel / 8;
+  for (size_t x = 0; x < width_; x++)
+  {
+    pixels[x] = (*reinterpret_cast<const uint32_t*>(row + x * stride)) & 0x00FFFFFF;
+  }
+}
+
+ImageX11Regions::ImageX11Regions(size_t width, size_t height, std::vector<Region> regions) : regions_(std::move(regions))
+{
+  width_ = width;
+  height_ = height;
+}
+
+void ImageX11Regions::convertToBitmap()
+{
+  if (shared_memory_)
+  {
+    Bitmap map(height_, std::vector<uint32_t>(width_, 0));
+    for (size_t y = 0; y < height_; y++)
+    {
+      for (size_t x = 0; x < width_; x++)
+      {
+        map[y][x] = pixel(x, y);
+      }
+    }
+    map_ = std::move(map);
+    shared_memory_ = false;
+  }
+}
+
+uint32_t ImageX11Regions::pixel(size_t x, size_t y) const
+{
+  if (!shared_memory_)
+  {
+    return map_[y][x];
+  }
+  for (size_t i = 0; i < regions_.size(); i++)
+  {
+    const size_t index = (last_ + i) % regions_.size();
+    const Box& box = regions_[index].box;
+    if ((x >= box.x_min) && (x < box.x_max) && (y >= box.y_min) && (y < box.y_max))
+    {
+      last_ = index;
+      const XImage& image = *regions_[index].image;
+      const uint8_t* data = reinterpret_cast<const uint8_t*>(image.data);
+      const size_t stride = image.bits_per_pixel / 8;
+      const size_t offset = (y - box.y_min) * image.bytes_per_line + (x - box.x_min) * stride;
+      return (*reinterpret_cast<const uint32_t*>(data + offset)) & 0x00FFFFFF;
+    }
+  }
+  return 0;
+}
+
+void ImageX11Regions::copyRow(size_t y, uint32_t* pixels) const
+{
+  if (!shared_memory_)
+  {
+    Image::copyRow(y, pixels);
+    return;
+  }
+  std::fill(pixels, pixels + width_, 0);
+  for (const auto& region : regions_)
+  {
+    const Box& box = region.box;
+    if ((y < box.y_min) || (y >= box.y_max))
+    {
+      continue;
+    }
+    const XImage& image = *region.image;
+    const uint8_t* row = reinterpret_cast<const uint8_t*>(image.data) + (y - box.y_min) * image.bytes_per_line;
+    const size_t stride = image.bits_per_pixel / 8;
+    for (size_t x = box.x_min; x < box.x_max; x++)
+    {
+      pixels[x] = (*reinterpret_cast<const uint32_t*>(row + (x - box.x_min) * stride)) & 0x00FFFFFF;
+    }
+  }
+}
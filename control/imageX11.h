@@ -24,6 +24,7 @@
 #include <vector>
 
 #include <X11/Xresource.h>
+#include "box.h"
 #include "image.h"
 
 /**
@@ -61,6 +62,56 @@ public:
    * @brief Return the value of a pixel on the ImageX11. Format is 0x00RRGGBB
    */
   uint32_t pixel(size_t x, size_t y) const;
+
+  /**
+   * @brief Copy a row of the ImageX11 into the provided buffer.
+   */
+  void copyRow(size_t y, uint32_t* pixels) const;
+};
+
+/**
+ * @brief Image that is backed by multiple XImages, each holding a region of the image. Pixels outside of all regions
+ *        are black. Used to capture only the parts of the screen that are analyzed.
+ */
+class ImageX11Regions : public Image
+{
+public:
+  /**
+   * @brief A region of the image and the XImage holding its pixels.
+   */
+  struct Region
+  {
+    Box box;                        //!< Position of the region in the image.
+    std::shared_ptr<XImage> image;  //!< The pixels of the region.
+  };
+
+  /**
+   * @brief Construct the image from its regions.
+   * @param width The width of the image.
+   * @param height The height of the image.
+   * @param regions The regions, where they overlap they should hold the same pixels.
+   */
+  ImageX11Regions(size_t width, size_t height, std::vector<Region> regions);
+
+  /**
+   * @brief Copy all regions into a bitmap.
+   */
+  void convertToBitmap();
+
+  /**
+   * @brief Return the value of a pixel on the image. Format is 0x00RRGGBB
+   */
+  uint32_t pixel(size_t x, size_t y) const;
+
+  /**
+   * @brief Copy a row of the image into the provided buffer, the parts outside of all regions are black.
+   */
+  void copyRow(size_t y, uint32_t* pixels) const;
+
+private:
+  std::vector<Region> regions_;  //!< The regions holding the pixels.
+  bool shared_memory_{ true };   //!< True if the regions are used, false if the bitmap is used.
+  mutable size_t last_{ 0 };     //!< Region that held the previous pixel, consecutive pixels tend to share one.
 };
 
 #endif
\ No newline at end of file
@@ -18,87 +18,541 @@
   SOFTWARE.
 */
 #include "lights.h"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 
-bool Lights::connect(const std::string& serial_path, size_t baudrate)
+Lights::~Lights()
 {
-  try
+  io_work_.reset();
+  io_.stop();
+  if (io_thread_.joinable())
   {
-    serial_ = std::make_unique<boost::asio::serial_port>(io_, serial_path);
-    serial_->set_option(boost::asio::serial_port_base::baud_rate(baudrate));
+    io_thread_.join();
   }
-  catch (boost::system::system_error& e)
+}
+
+bool Lights::connect(const std::string& output, size_t baudrate)
+{
+  return connect(Output::create(io_, output, baudrate));
+}
+
+boost::asio::io_service& Lights::ioService()
+{
+  return io_;
+}
+
+bool Lights::connect(Output::Ptr output)
+{
+  if (!output)
   {
-    std::cerr << "Error: " << e.what() << std::endl;
     return false;
   }
+
+  // Start the io thread that performs the writes, if it isn't running yet.
+  if (!io_thread_.joinable())
+  {
+    io_work_ = std::make_unique<boost::asio::io_service::work>(io_);
+    io_thread_ = std::thread([this]() { io_.run(); });
+  }
+
+  // Swap the output on the io thread, in between the handlers that use it. Then start listening for acknowledgements
+  // from the new output, the reads from the previous one stop.
+  auto next = std::make_shared<Output::Ptr>(std::move(output));  // The handler has to be copyable.
+  io_.post([this, next]() {
+    output_ = std::move(*next);
+    ack_filled_ = 0;
+    readAck(++connection_);
+  });
   return true;
 }
 
-std::vector<Message> Lights::chunker(const std::vector<RGB>& canvas) const
+Lights::Lights()
+  : staging_(chunker()), pending_(chunker()), in_flight_(chunker()), compact_(chunker(COLOR_RGB565)), device_(chunker())
 {
-  std::vector<Message> res;
+  setLimitFactor(limit_factor_);
+  buffers_.reserve(message_count_);
+}
 
-  // Setup message to set colors.
-  Message msg;
-  msg.type = COLOR;
-  msg.color.offset = 0;
-  msg.color.settings = 0;
+std::vector<Message> Lights::chunker(MsgType type)
+{
+  const size_t leds_per_message =
+      (type == COLOR_RGB565) ? ColorData565::leds_per_message : ColorData::leds_per_message;
+  std::vector<Message> res{ (led_count_ + leds_per_message - 1) / leds_per_message };
 
-  const size_t leds_per_message = msg.color.leds_per_message;
-  for (size_t index = 0; index < canvas.size(); index++)
+  // Setup messages to set colors, each message holds the colors of leds_per_message leds.
+  for (size_t i = 0; i < res.size(); i++)
   {
-    // Set the offset of this message, flooring the index
-    msg.color.offset = (index / leds_per_message) * leds_per_message;
+    Message& msg = res[i];
+    msg = Message{};
+    msg.type = type;
+    if (type == COLOR_RGB565)
+    {
+      msg.color565.offset = i * leds_per_message;
+    }
+    else
+    {
+      msg.color.offset = i * leds_per_message;
+    }
+  }
+  return res;
+}
 
-    // Set the color with the desired color from the canvas
-    msg.color.color[index % leds_per_message] = canvas[index];
+Lights::CanvasView Lights::canvas()
+{
+  return CanvasView{ staging_.data(), led_count_ };
+}
 
-    // Limit the color
-    limiter(msg.color.color[index % leds_per_message]);
+void Lights::fill(const RGB v)
+{
+  auto view = canvas();
+  for (size_t i = 0; i < view.size(); i++)
+  {
+    view[i] = v;
+  }
+  write();
+}
+
+void Lights::write(const std::vector<RGB>& canvas)
+{
+  auto view = this->canvas();
+  for (size_t i = 0; i < std::min(canvas.size(), view.size()); i++)
+  {
+    view[i] = canvas[i];
+  }
+  write();
+}
 
-    if ((index + 1) % leds_per_message == 0)  // If message is complete, push it into the vector.
+void Lights::write()
+{
+  limiter(staging_);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (has_pending_)
+  {
+    // The previous frame never made it to the output, it is superseded by this one.
+    statistics_.frames_dropped++;
+  }
+  std::swap(staging_, pending_);
+  has_pending_ = true;
+  pending_submitted_ = std::chrono::steady_clock::now();
+  publishStatistics();
+
+  // Only wake the io thread if it is idle, otherwise it picks up the pending frame when the current write completes.
+  if (!writing_)
+  {
+    writing_ = true;
+    io_.post([this]() { startWrite(); });
+  }
+}
+
+/**
+ * @brief Return true if any channel of any led differs more than threshold between the two color messages.
+ */
+static bool colorsDiffer(const ColorData& a, const ColorData& b, size_t threshold)
+{
+  for (size_t i = 0; i < ColorData::leds_per_message; i++)
+  {
+    if ((static_cast<size_t>(std::abs(a.color[i].R - b.color[i].R)) > threshold) ||
+        (static_cast<size_t>(std::abs(a.color[i].G - b.color[i].G)) > threshold) ||
+        (static_cast<size_t>(std::abs(a.color[i].B - b.color[i].B)) > threshold))
     {
-      res.push_back(msg);
+      return true;
     }
   }
+  return false;
+}
 
-  // Tell the hardware to actually set the message after.
-  res.back().color.settings = msg.color.settings_show_after;
-  return res;
+/**
+ * @brief Return true if any channel of any led differs more than threshold between the two RGB565 color messages.
+ */
+static bool colorsDiffer(const ColorData565& a, const ColorData565& b, size_t threshold)
+{
+  for (size_t i = 0; i < ColorData565::leds_per_message; i++)
+  {
+    if (a.color[i] == b.color[i])
+    {
+      continue;
+    }
+    const RGB ca = ColorData565::decode(a.color[i]);
+    const RGB cb = ColorData565::decode(b.color[i]);
+    if ((static_cast<size_t>(std::abs(ca.R - cb.R)) > threshold) ||
+        (static_cast<size_t>(std::abs(ca.G - cb.G)) > threshold) ||
+        (static_cast<size_t>(std::abs(ca.B - cb.B)) > threshold))
+    {
+      return true;
+    }
+  }
+  return false;
 }
 
-void Lights::fill(const RGB v) const
+/**
+ * @brief Return a reference to the settings of a color message, of either encoding.
+ */
+static uint8_t& settings(Message& msg)
 {
-  std::vector<RGB> res{ led_count_, v };
-  write(res);
+  return (msg.type == COLOR_RGB565) ? msg.color565.settings : msg.color.settings;
 }
 
-void Lights::write(const std::vector<RGB>& canvas) const
+void Lights::encodeRGB565(const std::vector<Message>& frame, std::vector<Message>& compact)
 {
-  auto msgs = chunker(canvas);
-  for (const auto& msg : msgs)
+  // Lookup tables for the rounded 5 and 6 bit channel values, already shifted into position.
+  struct Tables
+  {
+    std::array<uint16_t, 256> r;
+    std::array<uint16_t, 256> g;
+    std::array<uint16_t, 256> b;
+    Tables()
+    {
+      for (size_t i = 0; i < 256; i++)
+      {
+        r[i] = ColorData565::encode(i, 0, 0);
+        g[i] = ColorData565::encode(0, i, 0);
+        b[i] = ColorData565::encode(0, 0, i);
+      }
+    }
+  };
+  static const Tables tables;
+
+  // Walk both frames sequentially, avoiding a division per led.
+  size_t out_msg = 0;
+  size_t out_index = 0;
+  for (size_t led = 0; led < led_count_; led++)
   {
-    boost::asio::write(*serial_, boost::asio::buffer(&msg, sizeof(msg)));
+    const RGB& c = frame[led / ColorData::leds_per_message].color.color[led % ColorData::leds_per_message];
+    compact[out_msg].color565.color[out_index] = tables.r[c.R] | tables.g[c.G] | tables.b[c.B];
+    if (++out_index == ColorData565::leds_per_message)
+    {
+      out_index = 0;
+      out_msg++;
+    }
   }
 }
 
-void Lights::limiter(RGB& rgb) const
+void Lights::startWrite()
 {
-  rgb.R *= limit_factor_;
-  rgb.G *= limit_factor_;
-  rgb.B *= limit_factor_;
+  size_t delta_threshold = 0;
+  size_t full_refresh_interval = 0;
+  size_t full_refresh_ms = 0;
+  MsgType encoding = COLOR;
+  bool request_ack = false;
+  size_t ack_timeout_ms = 0;
+  uint16_t transition_ms = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_pending_)
+    {
+      writing_ = false;
+      return;
+    }
+    request_ack = (max_frames_in_flight_ != 0) && output_->acknowledges();
+    ack_timeout_ms = ack_timeout_ms_;
+    if (request_ack && (statistics_.frames_unacknowledged >= max_frames_in_flight_))
+    {
+      // Too many frames have not been shown yet. Wait for an acknowledgement, until then the pending frame can still
+      // be replaced by newer frames.
+      waiting_for_ack_ = true;
+    }
+    else
+    {
+      std::swap(pending_, in_flight_);
+      in_flight_submitted_ = pending_submitted_;
+      has_pending_ = false;
+      publishStatistics();
+      delta_threshold = delta_threshold_;
+      full_refresh_interval = full_refresh_interval_;
+      full_refresh_ms = full_refresh_ms_;
+      encoding = encoding_;
+      transition_ms = transition_ms_;
+    }
+  }
+
+  if (waiting_for_ack_)
+  {
+    ack_timer_.expires_from_now(std::chrono::milliseconds(ack_timeout_ms));
+    ack_timer_.async_wait([this](const boost::system::error_code& error) { handleAckTimeout(error); });
+    return;
+  }
+
+  // Encode the frame into the compact representation if that's used.
+  sent_ = &in_flight_;
+  if (encoding == COLOR_RGB565)
+  {
+    encodeRGB565(in_flight_, compact_);
+    sent_ = &compact_;
+  }
+  std::vector<Message>& frame = *sent_;
+
+  // If the encoding changed, the known device state can't be compared against.
+  if (device_.front().type != encoding)
+  {
+    device_ = chunker(encoding);
+    device_stale_ = true;
+  }
+
+  // Collect the messages that differ from what the device has, or all of them if a full refresh is due.
+  const auto now = std::chrono::steady_clock::now();
+  const bool full_refresh =
+      device_stale_ || ((full_refresh_interval != 0) && (frames_since_refresh_ + 1 >= full_refresh_interval)) ||
+      ((full_refresh_ms != 0) && (now - last_refresh_ >= std::chrono::milliseconds(full_refresh_ms)));
+  buffers_.clear();
+  Message* last = nullptr;
+  for (size_t i = 0; i < frame.size(); i++)
+  {
+    settings(frame[i]) = 0;
+    const bool changed = (encoding == COLOR_RGB565) ?
+                             colorsDiffer(frame[i].color565, device_[i].color565, delta_threshold) :
+                             colorsDiffer(frame[i].color, device_[i].color, delta_threshold);
+    if (full_refresh || changed)
+    {
+      buffers_.push_back(boost::asio::buffer(&frame[i], sizeof(Message)));
+      last = &frame[i];
+    }
+  }
+  frames_since_refresh_ = full_refresh ? 0 : frames_since_refresh_ + 1;
+  last_refresh_ = full_refresh ? now : last_refresh_;
+  device_stale_ = false;
+
+  if (last == nullptr)
+  {
+    // Nothing changed, no need to write anything. Check if a new frame arrived in the meantime, posted such that a
+    // fast producer doesn't grow the stack.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      statistics_.frames_unchanged++;
+      publishStatistics();
+    }
+    io_.post([this]() { startWrite(); });
+    return;
+  }
+
+  // Tell the hardware to show the leds after the last message that is sent, and acknowledge that if desired.
+  settings(*last) = ColorData::settings_show_after | (request_ack ? ColorData::settings_ack : 0);
+
+  // Number the frame, such that the acknowledgement can be related to it.
+  sequence_++;
+  for (auto& msg : frame)
+  {
+    msg.sequence = sequence_;
+    msg.transition_ms = transition_ms;
+  }
+  submitted_[sequence_] = in_flight_submitted_;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_active_ = true;
+    write_latency_.start();
+    if (request_ack)
+    {
+      statistics_.frames_unacknowledged++;
+    }
+    publishStatistics();
+  }
+
+  // The changed messages are handed to the output in a single gather write.
+  output_->asyncWrite(buffers_, [this](const boost::system::error_code& error, std::size_t) { handleWrite(error); });
+}
+
+void Lights::handleWrite(const boost::system::error_code& error)
+{
+  if (error)
+  {
+    // Unknown what made it to the device, make sure the next frame is sent in full.
+    device_stale_ = true;
+  }
+  else
+  {
+    // The device now holds the messages that were written.
+    for (const auto& buffer : buffers_)
+    {
+      const Message* msg = static_cast<const Message*>(buffer.data());
+      device_[msg - sent_->data()] = *msg;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_latency_.stop();
+    write_active_ = false;
+    if (error)
+    {
+      statistics_.write_errors++;
+    }
+    else
+    {
+      statistics_.frames_written++;
+      statistics_.messages_written += buffers_.size();
+      statistics_.bytes_written += boost::asio::buffer_size(buffers_);
+    }
+    publishStatistics();
+  }
+  if (error)
+  {
+    std::cerr << "Error writing to output: " << error.message() << std::endl;
+  }
+  startWrite();
+}
+
+void Lights::readAck(size_t connection)
+{
+  if (!output_ || (connection != connection_))
+  {
+    return;
+  }
+  output_->asyncRead(
+      boost::asio::buffer(ack_buffer_.data() + ack_filled_, ack_buffer_.size() - ack_filled_),
+      [this, connection](const boost::system::error_code& error, std::size_t) {
+        if (connection != connection_)
+        {
+          return;  // Read from an output that was replaced.
+        }
+        if (error)
+        {
+          if (error != boost::asio::error::operation_aborted)
+          {
+            std::cerr << "Error reading from output: " << error.message() << std::endl;
+          }
+          return;
+        }
+        if (ack_buffer_[0] == ACK)
+        {
+          handleAck(ack_buffer_[1]);
+          ack_filled_ = 0;
+        }
+        else
+        {
+          // Out of sync, drop the first byte and read one more.
+          ack_buffer_[0] = ack_buffer_[1];
+          ack_filled_ = 1;
+        }
+        readAck(connection);
+      });
+}
+
+void Lights::handleAck(uint8_t sequence)
+{
+  const auto now = std::chrono::steady_clock::now();
+  bool resume = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The frames written after the acknowledged one are still outstanding.
+    const size_t outstanding = static_cast<uint8_t>(sequence_ - sequence);
+    if (outstanding >= statistics_.frames_unacknowledged)
+    {
+      return;  // Acknowledgement of a frame that was already considered lost.
+    }
+
+    // The device processes frames in order, frames before this one are shown as well.
+    statistics_.frames_acknowledged += statistics_.frames_unacknowledged - outstanding;
+    statistics_.frames_unacknowledged = outstanding;
+    std::chrono::duration<double, std::micro> latency = now - submitted_[sequence];
+    statistics_.ack_latency.add(latency.count());
+    resume = waiting_for_ack_ && (outstanding < max_frames_in_flight_);
+    publishStatistics();
+  }
+
+  if (resume)
+  {
+    waiting_for_ack_ = false;
+    ack_timer_.cancel();
+    startWrite();
+  }
+}
+
+void Lights::handleAckTimeout(const boost::system::error_code& error)
+{
+  if (error || !waiting_for_ack_)
+  {
+    return;  // Cancelled, the acknowledgement arrived.
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.acks_lost += statistics_.frames_unacknowledged;
+    statistics_.frames_unacknowledged = 0;
+    publishStatistics();
+  }
+  // Unknown what the device has shown, resend everything.
+  device_stale_ = true;
+  waiting_for_ack_ = false;
+  startWrite();
+}
+
+void Lights::setTransition(uint16_t transition_ms)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  transition_ms_ = transition_ms;
+}
+
+void Lights::setFlowControl(size_t max_frames_in_flight, size_t ack_timeout_ms)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_frames_in_flight_ = max_frames_in_flight;
+  ack_timeout_ms_ = ack_timeout_ms;
+}
+
+void Lights::publishStatistics()
+{
+  statistics_.queue_depth = (has_pending_ ? 1 : 0) + (write_active_ ? 1 : 0);
+  statistics_.write_latency_us =
+      (statistics_.frames_written + statistics_.write_errors) ? write_latency_.average() : 0.0;
+  published_.store(statistics_);
+}
+
+Lights::Statistics Lights::getStatistics() const
+{
+  return published_.load();
+}
+
+void Lights::limiter(std::vector<Message>& frame) const
+{
+  for (auto& msg : frame)
+  {
+    for (auto& rgb : msg.color.color)
+    {
+      rgb.R = limit_table_[rgb.R];
+      rgb.G = limit_table_[rgb.G];
+      rgb.B = limit_table_[rgb.B];
+    }
+  }
 }
 
 void Lights::setLimitFactor(double factor)
 {
   limit_factor_ = factor;
+  // Precompute the limited value for each channel value, this is identical to multiplying each channel.
+  for (size_t i = 0; i < limit_table_.size(); i++)
+  {
+    limit_table_[i] = static_cast<uint8_t>(std::min(255.0, i * limit_factor_));
+  }
 }
 
-void Lights::writeBoundsCanvas() const
+bool Lights::setEncoding(MsgType type)
 {
-  auto z = makeCanvas();
+  if ((type != COLOR) && (type != COLOR_RGB565))
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  encoding_ = type;
+  return true;
+}
+
+void Lights::setDeltaEncoding(size_t threshold, size_t full_refresh_interval, size_t full_refresh_ms)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  delta_threshold_ = threshold;
+  full_refresh_interval_ = full_refresh_interval;
+  full_refresh_ms_ = full_refresh_ms;
+}
+
+void Lights::writeBoundsCanvas()
+{
+  auto z = canvas();
+  for (size_t i = 0; i < z.size(); i++)
+  {
+    z[i] = { 0, 0, 0 };
+  }
   z[41].R = 255;
   z[41].B = 255;
 
@@ -112,7 +566,7 @@ void Lights::writeBoundsCanvas() const
   z[156].G = 255;
 
   z[227].G = 255;
-  write(z);
+  write();
 }
 
 std::vector<Box> Lights::getBoxes(size_t width, size_t height, size_t horizontal_depth, size_t vertical_depth)
@@ -20,26 +20,123 @@
 #ifndef LIGHTS_H
 #define LIGHTS_H
 
+#include <array>
 #include <boost/asio.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "../firmware/messages.h"
 #include "box.h"
+#include "output.h"
+#include "snapshot.h"
+#include "timing.h"
 
 /**
  * @brief This class represents the hardware. It both provides information about where each LED is positioned and which
- *        section each led should represent given some area. It also serves as the interface to the hardware via the
- *        serial port.
+ *        section each led should represent given some area. It also serves as the interface to the hardware via an
+ *        Output, usually the serial port.
  * @note This class contains all the hardware specific values.
+ *
+ * Writing to the output happens asynchronously on a dedicated io thread. Only the newest frame is kept while a
+ * write is in flight, older frames that were never started are discarded. This ensures a slow or stalled controller
+ * never holds back the analysis loop.
+ *
+ * The frames are persistent buffers of messages with their headers already filled in. The analyzer writes colors
+ * directly into these messages through the CanvasView returned by canvas(), so the output path performs no allocations
+ * and no copies in steady state.
+ *
+ * Only the color messages that changed compared to the state the device is known to have are sent. A message is
+ * considered changed if any channel of any of its leds differs more than the delta threshold. Every so many frames,
+ * and whenever the last full frame is older than the full refresh time, a full frame is sent to guard against
+ * divergence. The full refresh time is below the firmware's decay delay, which keeps the leds from decaying on a static
+ * screen as long as frames keep being written at a few hz or more.
+ *
+ * Each frame carries a sequence number. With flow control enabled the device acknowledges each frame after showing it,
+ * this limits the number of frames that are sent but not yet shown and provides the latency from write() until the
+ * leds show the frame.
  */
 class Lights
 {
 public:
   /**
-   * @brief Connect to the serial port.
-   * @param serial_path The path to the serial port, usually /dev/ttyACM* or /dev/ttyUSB*
-   * @param baudrate The baudrate to use for communication.
+   * @brief Statistics about the output path.
+   */
+  struct Statistics
+  {
+    size_t frames_written{ 0 };         //!< Number of frames that completed writing.
+    size_t frames_dropped{ 0 };         //!< Number of frames that got replaced by a newer one before being written.
+    size_t write_errors{ 0 };           //!< Number of writes that failed.
+    size_t frames_unchanged{ 0 };       //!< Number of frames that did not differ from the device, nothing was written.
+    size_t messages_written{ 0 };       //!< Number of messages written to the output.
+    size_t bytes_written{ 0 };          //!< Number of bytes written to the output.
+    size_t frames_acknowledged{ 0 };    //!< Number of frames the device acknowledged to have shown.
+    size_t frames_unacknowledged{ 0 };  //!< Frames that are written but not yet acknowledged.
+    size_t acks_lost{ 0 };              //!< Frames for which the acknowledgement did not arrive in time.
+    Histogram ack_latency;              //!< Durations from write() until the device acknowledged showing the frame.
+    size_t queue_depth{ 0 };            //!< Frames currently pending or in flight, at most two.
+    double write_latency_us{ 0 };       //!< Average duration of a frame's write to the output, in microseconds.
+  };
+
+  /**
+   * @brief Indexed view on the colors in a frame of color messages. Writing to an index writes directly into the
+   *        message that will be sent to the leds.
+   */
+  class CanvasView
+  {
+  public:
+    CanvasView(Message* messages, size_t size) : messages_(messages), size_(size)
+    {
+    }
+
+    RGB& operator[](size_t index)
+    {
+      return messages_[index / ColorData::leds_per_message].color.color[index % ColorData::leds_per_message];
+    }
+
+    const RGB& operator[](size_t index) const
+    {
+      return messages_[index / ColorData::leds_per_message].color.color[index % ColorData::leds_per_message];
+    }
+
+    size_t size() const
+    {
+      return size_;
+    }
+
+  private:
+    Message* messages_;  //!< The first color message of the frame.
+    size_t size_;        //!< The number of leds in the frame.
+  };
+
+  Lights();
+  Lights(const Lights&) = delete;
+  Lights& operator=(const Lights&) = delete;
+
+  /**
+   * @brief Stops the io thread, a write that is in flight is abandoned.
+   */
+  ~Lights();
+
+  /**
+   * @brief Connect to the output, replacing the current one.
+   * @param output The path to the serial port, usually /dev/ttyACM* or /dev/ttyUSB*. Alternatively, "null", "pty" or
+   *        "file:<path>" to write to one of the other outputs, see Output::create.
+   * @param baudrate The baudrate to use for communication with a serial port.
    * @return true on success, false in case an error occured.
    */
-  bool connect(const std::string& serial_path, size_t baudrate = 115200);
+  bool connect(const std::string& output, size_t baudrate = 115200);
+
+  /**
+   * @brief Connect to an output that was created on ioService(), replacing the current one.
+   * @return true on success, false if the output is nullptr.
+   */
+  bool connect(Output::Ptr output);
+
+  /**
+   * @brief Return the io service that runs the handlers of the output, outputs passed to connect() must use it.
+   */
+  boost::asio::io_service& ioService();
 
   /**
    * @brief Return the total number of LEDs present.
@@ -50,10 +147,29 @@ public:
   }
 
   /**
-   * @brief Write a canvas to the leds.
+   * @brief Return a view on the frame that will be sent by the next call to write(). The view is invalidated by
+   *        write(), obtain a new one for each frame. Its contents are unspecified, every led should be assigned.
+   */
+  CanvasView canvas();
+
+  /**
+   * @brief Write the frame that was populated through canvas() to the leds, this returns immediately. If a previous
+   *        frame is still being written this frame is queued, replacing any frame that was queued earlier. The limiter
+   *        is applied to the colors in place.
+   */
+  void write();
+
+  /**
+   * @brief Write a canvas to the leds, copies the canvas into the frame and calls write().
    * @param canvas the canvas to write to the leds. The limiter will be applied to this.
    */
-  void write(const std::vector<RGB>& canvas) const;
+  void write(const std::vector<RGB>& canvas);
+
+  /**
+   * @brief Return the statistics of the output path. This doesn't take any locks, so querying them from another thread
+   *        never holds up writing frames.
+   */
+  Statistics getStatistics() const;
 
   /**
    * @brief Set the factor to be used by the limiter. All color channels are multiplied by this factor before being
@@ -61,15 +177,48 @@ public:
    */
   void setLimitFactor(double factor);
 
+  /**
+   * @brief Configure the delta encoding of frames.
+   * @param threshold Messages in which no channel of any led changed more than this are not sent.
+   * @param full_refresh_interval Send the full frame every this many frames, 0 disables full refreshes, 1 sends
+   *        every frame in full.
+   * @param full_refresh_ms Send the full frame if the last one was sent longer ago than this, 0 disables it. Keep
+   *        this below the firmware's decay delay of 1000 ms.
+   */
+  void setDeltaEncoding(size_t threshold, size_t full_refresh_interval, size_t full_refresh_ms = 500);
+
+  /**
+   * @brief Set the message type used to send colors. COLOR sends 8 bits per channel in 12 messages, COLOR_RGB565 sends
+   *        5, 6 and 5 bits for red, green and blue in 9 messages.
+   * @return False if the type is not a color message type.
+   */
+  bool setEncoding(MsgType type);
+
+  /**
+   * @brief Configure flow control, this requests an acknowledgement from the device for each frame. It has no effect on
+   *        outputs that never acknowledge frames, such as the networked controllers.
+   * @param max_frames_in_flight The maximum number of frames that are written but not yet acknowledged, when reached
+   *        no new frames are written until an acknowledgement arrives. 0 disables flow control and acknowledgements.
+   * @param ack_timeout_ms If no acknowledgement arrives within this time, the outstanding frames are considered lost.
+   */
+  void setFlowControl(size_t max_frames_in_flight, size_t ack_timeout_ms = 100);
+
+  /**
+   * @brief Set the duration over which the firmware transitions from the shown colors to each new frame. When frames
+   *        are written at a low rate, setting this to the frame period gives smooth output at the firmware's rate.
+   * @param transition_ms The duration in milliseconds, 0 shows frames immediately.
+   */
+  void setTransition(uint16_t transition_ms);
+
   /**
    * @brief Fill the leds with a certain color.
    */
-  void fill(const RGB v = { 0, 0, 0 }) const;
+  void fill(const RGB v = { 0, 0, 0 });
 
   /**
    * @brief Set a dummy canvas that colors the end of each segment on the leds.
    */
-  void writeBoundsCanvas() const;
+  void writeBoundsCanvas();
 
   /**
    * @brief Create the box that's associated to each led for an rectangle of an arbritrary dimension.
@@ -89,20 +238,103 @@ private:
   static constexpr const size_t horizontal_count_{ 42 };  //!< Number of cells in horizontal direction.
   static constexpr const size_t vertical_count_{ 73 };    //!< Number of cells in vertical direction.
   static constexpr const size_t led_count_{ 228 };        //!< The number of leds in total.
+  //! The number of color messages needed to send all leds.
+  static constexpr const size_t message_count_{ (led_count_ + ColorData::leds_per_message - 1) /
+                                                ColorData::leds_per_message };
+
+  /**
+   * @brief Internal helper function that creates a frame of color messages with all headers populated, such that it
+   *        can be sent to the output as is.
+   * @param type The message type of the frame, either COLOR or COLOR_RGB565.
+   */
+  static std::vector<Message> chunker(MsgType type = COLOR);
 
   /**
-   * @brief Internal helper function that converts a canvas in a list of messages that can be sent to the serial port.
+   * @brief Encode the colors of a COLOR frame into a COLOR_RGB565 frame.
    */
-  std::vector<Message> chunker(const std::vector<RGB>& canvas) const;
+  static void encodeRGB565(const std::vector<Message>& frame, std::vector<Message>& compact);
 
   /**
-   * @brief Apply the limiter to an RGB tuple.
+   * @brief Apply the limiter to all colors in a frame.
    */
-  void limiter(RGB& rgb) const;
+  void limiter(std::vector<Message>& frame) const;
+
+  /**
+   * @brief Start writing the pending frame if there is one, only called from the io thread.
+   */
+  void startWrite();
+
+  /**
+   * @brief Completion handler of the asynchronous write, runs on the io thread.
+   */
+  void handleWrite(const boost::system::error_code& error);
+
+  /**
+   * @brief Start reading acknowledgements from the output, runs on the io thread.
+   * @param connection The connection the reads belong to, they stop once the output is replaced.
+   */
+  void readAck(size_t connection);
+
+  /**
+   * @brief Process a received acknowledgement, runs on the io thread.
+   */
+  void handleAck(uint8_t sequence);
+
+  /**
+   * @brief Called when an acknowledgement did not arrive in time, runs on the io thread.
+   */
+  void handleAckTimeout(const boost::system::error_code& error);
+
+  /**
+   * @brief Publish the statistics for getStatistics(), must be called with mutex_ held after they changed.
+   */
+  void publishStatistics();
+
+  boost::asio::io_service io_;                              //!< IO service.
+  Output::Ptr output_;                                      //!< The output the messages are written to.
+  size_t connection_{ 0 };                                  //!< Number of outputs connected, only used on the io thread.
+  std::unique_ptr<boost::asio::io_service::work> io_work_;  //!< Keeps the io service running while idle.
+  std::thread io_thread_;                                   //!< Thread that runs the io service.
+  double limit_factor_{ 0.5 };                              //!< Limiter multiplication factor.
+  std::array<uint8_t, 256> limit_table_;                    //!< Lookup table holding the limited channel values.
+  std::vector<Message> staging_;                            //!< Frame that is populated through canvas().
+
+  mutable std::mutex mutex_;            //!< Guards the members below, these are shared with the io thread.
+  std::vector<Message> pending_;        //!< Newest frame that is waiting to be written.
+  std::vector<Message> in_flight_;      //!< Frame that is currently being written.
+  bool has_pending_{ false };           //!< True if pending_ holds a frame that still has to be written.
+  bool writing_{ false };               //!< True while the io thread is busy writing frames.
+  bool write_active_{ false };          //!< True while in_flight_ is being written to the output.
+  Statistics statistics_;               //!< Output statistics, queue_depth is computed when they are published.
+  Measure write_latency_;               //!< Duration of each write to the output.
+  size_t delta_threshold_{ 0 };         //!< Channel difference up to which a led is unchanged.
+  size_t full_refresh_interval_{ 30 };  //!< Number of frames between sending the full frame.
+  size_t full_refresh_ms_{ 500 };       //!< Longest time between sending the full frame.
+  MsgType encoding_{ COLOR };           //!< The message type used to send colors.
+  size_t max_frames_in_flight_{ 0 };    //!< Maximum unacknowledged frames, 0 is disabled.
+  size_t ack_timeout_ms_{ 100 };        //!< Time after which acknowledgements are lost.
+  uint16_t transition_ms_{ 0 };         //!< Duration of the firmware's transition to a new frame.
+  //! When the pending frame was passed to write().
+  std::chrono::steady_clock::time_point pending_submitted_;
+  Snapshot<Statistics> published_;  //!< Copy of the statistics that is read without taking mutex_.
 
-  std::unique_ptr<boost::asio::serial_port> serial_;  //!< Object to interact with the serial port.
-  boost::asio::io_service io_;                        //!< IO service.
-  double limit_factor_{ 0.5 };                        //!< Limiter multiplication factor.
+  // Only accessed from the io thread.
+  std::vector<Message> compact_;                        //!< The in flight frame encoded as COLOR_RGB565.
+  std::vector<Message>* sent_{ nullptr };               //!< Frame being written, in_flight_ or compact_.
+  std::vector<Message> device_;                         //!< The colors the device has received, per message.
+  std::vector<boost::asio::const_buffer> buffers_;      //!< The messages of in_flight_ that are being written.
+  size_t frames_since_refresh_{ 0 };                    //!< Frames written since the last full frame.
+  std::chrono::steady_clock::time_point last_refresh_;  //!< When the last full frame was written.
+  bool device_stale_{ true };                           //!< Device state is unknown, send a full frame.
+  uint8_t sequence_{ 0 };                               //!< Sequence number of the last frame written.
+  boost::asio::steady_timer ack_timer_{ io_ };          //!< Timer for the acknowledgement timeout.
+  bool waiting_for_ack_{ false };                       //!< True if writing is blocked by flow control.
+  std::array<uint8_t, sizeof(Ack)> ack_buffer_;         //!< Buffer for the acknowledgement being read.
+  size_t ack_filled_{ 0 };                              //!< Number of bytes in ack_buffer_.
+  //! When the in flight frame was passed to write().
+  std::chrono::steady_clock::time_point in_flight_submitted_;
+  //! Time each sequence number was passed to write(), indexed by sequence number.
+  std::array<std::chrono::steady_clock::time_point, 256> submitted_;
 };
 
 #endif
\ No newline at end of file
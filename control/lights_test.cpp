@@ -0,0 +1,672 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "../firmware/interpolator.h"
+#include "emulator.h"
+#include "lights.h"
+#include "outputUdp.h"
+
+/**
+ * @brief Pseudo terminal pair that stands in for the serial port of the device.
+ */
+struct PseudoTerminal
+{
+  int master{ -1 };  //!< File descriptor of the side the device emulator reads from.
+  int slave{ -1 };   //!< File descriptor of the side Lights connects to, kept open to keep the pair alive.
+  std::string path;  //!< Path of the slave device.
+
+  PseudoTerminal()
+  {
+    std::array<char, 256> name;
+    termios raw;
+    cfmakeraw(&raw);
+    if (openpty(&master, &slave, name.data(), &raw, nullptr) != 0)
+    {
+      throw std::runtime_error("Failed to open pseudo terminal.");
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    path = name.data();
+  }
+
+  ~PseudoTerminal()
+  {
+    close(master);
+    close(slave);
+  }
+
+  /**
+   * @brief Wait until lights has written everything, then pass all bytes that arrived to the emulator.
+   */
+  void drain(const Lights& lights, DeviceEmulator& emulator)
+  {
+    while (lights.getStatistics().queue_depth != 0)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    std::array<uint8_t, 4096> buffer;
+    ssize_t count = 0;
+    while ((count = read(master, buffer.data(), buffer.size())) > 0)
+    {
+      emulator.feed(buffer.data(), count);
+    }
+  }
+};
+
+/**
+ * @brief Stand-in for the firmware, runs the emulator on the device side of the pseudo terminal in a separate thread
+ *        and sends the acknowledgements back after the time it takes to show the leds.
+ */
+struct FirmwareStandIn
+{
+  FirmwareStandIn(int fd, DeviceEmulator emulator, size_t show_duration_us)
+    : fd_(fd), emulator_(emulator), show_duration_us_(show_duration_us)
+  {
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  ~FirmwareStandIn()
+  {
+    running_ = false;
+    thread_.join();
+  }
+
+  /**
+   * @brief Return the colors the emulated device shows.
+   */
+  std::vector<RGB> shown()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return emulator_.shown();
+  }
+
+private:
+  void run()
+  {
+    std::array<uint8_t, 4096> buffer;
+    while (running_)
+    {
+      pollfd pfd{ fd_, POLLIN, 0 };
+      if (poll(&pfd, 1, 1) <= 0)
+      {
+        continue;
+      }
+      ssize_t count = read(fd_, buffer.data(), buffer.size());
+      if (count <= 0)
+      {
+        continue;
+      }
+      std::vector<uint8_t> response;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        emulator_.feed(buffer.data(), count);
+        response = emulator_.takeResponse();
+      }
+      if (!response.empty())
+      {
+        // Pushing the data out to the leds takes time, the acknowledgement is sent after that.
+        std::this_thread::sleep_for(std::chrono::microseconds(show_duration_us_));
+        if (::write(fd_, response.data(), response.size()) != static_cast<ssize_t>(response.size()))
+        {
+          std::cerr << "Failed to write acknowledgement." << std::endl;
+        }
+      }
+    }
+  }
+
+  int fd_;                             //!< Device side of the pseudo terminal.
+  DeviceEmulator emulator_;            //!< The emulated device.
+  size_t show_duration_us_;            //!< Time it takes to show the leds.
+  std::mutex mutex_;                   //!< Guards the emulator.
+  std::atomic<bool> running_{ true };  //!< Set to false to stop the thread.
+  std::thread thread_;                 //!< Thread that runs the device.
+};
+
+/**
+ * @brief Return the largest difference of any channel between the device and the canvas.
+ */
+size_t maxDifference(const std::vector<RGB>& device, const std::vector<RGB>& canvas)
+{
+  size_t res = 0;
+  for (size_t i = 0; i < canvas.size(); i++)
+  {
+    res = std::max<size_t>(res, std::abs(device[i].R - canvas[i].R));
+    res = std::max<size_t>(res, std::abs(device[i].G - canvas[i].G));
+    res = std::max<size_t>(res, std::abs(device[i].B - canvas[i].B));
+  }
+  return res;
+}
+
+/**
+ * @brief Create the emulator with gamma disabled, such that its state can be compared to the canvas directly.
+ */
+DeviceEmulator makeEmulator()
+{
+  Config config = DeviceEmulator::defaultConfig();
+  config.gamma_r = 1.0;
+  config.gamma_g = 1.0;
+  config.gamma_b = 1.0;
+  return DeviceEmulator{ Lights::ledCount(), config };
+}
+
+/**
+ * @brief Generates a random walk of canvases, mixing scene changes, small changes and static frames.
+ */
+struct CanvasWalk
+{
+  std::mt19937 gen{ 1337 };
+  std::uniform_int_distribution<size_t> led_dist{ 0, Lights::ledCount() - 1 };
+  std::uniform_int_distribution<int> step_dist{ -4, 4 };
+  std::uniform_int_distribution<int> color_dist{ 0, 255 };
+  std::uniform_int_distribution<int> action_dist{ 0, 9 };
+
+  void step(std::vector<RGB>& canvas)
+  {
+    const int action = action_dist(gen);
+    if (action == 0)
+    {
+      // Scene change, everything changes.
+      for (auto& led : canvas)
+      {
+        led = { uint8_t(color_dist(gen)), uint8_t(color_dist(gen)), uint8_t(color_dist(gen)) };
+      }
+    }
+    else if (action < 5)
+    {
+      // Small changes on a few leds.
+      for (size_t i = 0; i < 5; i++)
+      {
+        auto& led = canvas[led_dist(gen)];
+        led.R = std::min(255, std::max(0, led.R + step_dist(gen)));
+        led.G = std::min(255, std::max(0, led.G + step_dist(gen)));
+        led.B = std::min(255, std::max(0, led.B + step_dist(gen)));
+      }
+    }
+    // Otherwise the canvas is static.
+  }
+};
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cout << "./" << argv[0] << " delta [frames] [threshold] [full_refresh_interval]" << std::endl;
+    std::cout << "./" << argv[0] << " rgb565 [frames]" << std::endl;
+    std::cout << "./" << argv[0] << " ack [frames] [max_frames_in_flight] [show_duration_us]" << std::endl;
+    std::cout << "./" << argv[0] << " interpolate" << std::endl;
+    std::cout << "./" << argv[0] << " throughput [output] [frames] [full_refresh_interval]" << std::endl;
+    std::cout << "./" << argv[0] << " udp [frames] [batch] [leds_per_packet]" << std::endl;
+    return 1;
+  }
+
+  // Send a random walk of canvases and verify the device never deviates more than the threshold.
+  if (std::string(argv[1]) == "delta")
+  {
+    const size_t frames = (argc >= 3) ? std::atoi(argv[2]) : 1000;
+    const size_t threshold = (argc >= 4) ? std::atoi(argv[3]) : 2;
+    const size_t full_refresh_interval = (argc >= 5) ? std::atoi(argv[4]) : 30;
+
+    PseudoTerminal pty;
+    Lights lights;
+    if (!lights.connect(pty.path))
+    {
+      return 1;
+    }
+    lights.setLimitFactor(1.0);
+    lights.setDeltaEncoding(threshold, full_refresh_interval);
+    DeviceEmulator emulator = makeEmulator();
+
+    CanvasWalk walk;
+    auto canvas = Lights::makeCanvas();
+    size_t failures = 0;
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+      walk.step(canvas);
+      lights.write(canvas);
+      pty.drain(lights, emulator);
+
+      const size_t difference = maxDifference(emulator.shown(), canvas);
+      if (difference > threshold)
+      {
+        std::cerr << "Frame " << frame << " deviates " << difference << " from the canvas." << std::endl;
+        failures++;
+      }
+    }
+
+    // A static canvas written at a low rate is refreshed in full before the firmware's decay dims the leds.
+    lights.setDeltaEncoding(threshold, 0);
+    for (size_t frame = 0; frame < 15; frame++)
+    {
+      lights.write(canvas);
+      pty.drain(lights, emulator);
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      emulator.advance(100000);
+    }
+    if (maxDifference(emulator.shown(), canvas) > threshold)
+    {
+      std::cerr << "The leds decayed while the canvas was static." << std::endl;
+      failures++;
+    }
+
+    const auto stats = lights.getStatistics();
+    std::cout << "Frames: " << frames << " written: " << stats.frames_written << " unchanged: " << stats.frames_unchanged
+              << " dropped: " << stats.frames_dropped << std::endl;
+    std::cout << "Messages: " << emulator.messageCount() << " bytes per frame: "
+              << double(emulator.messageCount() * sizeof(Message)) / frames << " (full frame is "
+              << (Lights::ledCount() + ColorData::leds_per_message - 1) / ColorData::leds_per_message * sizeof(Message)
+              << ")" << std::endl;
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // Send the same canvases with the COLOR and COLOR_RGB565 encoding, verify the devices end up with the same colors.
+  if (std::string(argv[1]) == "rgb565")
+  {
+    const size_t frames = (argc >= 3) ? std::atoi(argv[2]) : 1000;
+
+    PseudoTerminal color_pty;
+    PseudoTerminal compact_pty;
+    Lights color_lights;
+    Lights compact_lights;
+    if (!color_lights.connect(color_pty.path) || !compact_lights.connect(compact_pty.path))
+    {
+      return 1;
+    }
+    color_lights.setLimitFactor(1.0);
+    compact_lights.setLimitFactor(1.0);
+    compact_lights.setEncoding(COLOR_RGB565);
+    DeviceEmulator color_emulator = makeEmulator();
+    DeviceEmulator compact_emulator = makeEmulator();
+
+    CanvasWalk walk;
+    auto canvas = Lights::makeCanvas();
+    size_t failures = 0;
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+      walk.step(canvas);
+      color_lights.write(canvas);
+      compact_lights.write(canvas);
+      color_pty.drain(color_lights, color_emulator);
+      compact_pty.drain(compact_lights, compact_emulator);
+
+      // Rounding to 5 bits deviates at most 255 / 62 from the original, the 6 bit green channel half of that.
+      const auto& expected = color_emulator.shown();
+      const auto& compact = compact_emulator.shown();
+      for (size_t i = 0; i < canvas.size(); i++)
+      {
+        if ((std::abs(expected[i].R - compact[i].R) > 5) || (std::abs(expected[i].G - compact[i].G) > 3) ||
+            (std::abs(expected[i].B - compact[i].B) > 5))
+        {
+          std::cerr << "Frame " << frame << " led " << i << " differs between encodings." << std::endl;
+          failures++;
+        }
+      }
+    }
+
+    std::cout << "Messages COLOR: " << color_emulator.messageCount()
+              << " COLOR_RGB565: " << compact_emulator.messageCount() << std::endl;
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // Write frames faster than the device can show them, verify flow control and measure the latency.
+  if (std::string(argv[1]) == "ack")
+  {
+    const size_t frames = (argc >= 3) ? std::atoi(argv[2]) : 500;
+    const size_t max_frames_in_flight = (argc >= 4) ? std::atoi(argv[3]) : 1;
+    const size_t show_duration_us = (argc >= 5) ? std::atoi(argv[4]) : 7000;
+
+    PseudoTerminal pty;
+    FirmwareStandIn device(pty.master, makeEmulator(), show_duration_us);
+    Lights lights;
+    if (!lights.connect(pty.path))
+    {
+      return 1;
+    }
+    lights.setLimitFactor(1.0);
+    lights.setFlowControl(max_frames_in_flight);
+
+    CanvasWalk walk;
+    auto canvas = Lights::makeCanvas();
+    size_t failures = 0;
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+      walk.step(canvas);
+      lights.write(canvas);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      const auto stats = lights.getStatistics();
+      if (stats.frames_unacknowledged > max_frames_in_flight)
+      {
+        std::cerr << "Frame " << frame << " has " << stats.frames_unacknowledged << " frames in flight." << std::endl;
+        failures++;
+      }
+    }
+
+    // Wait for the last frame to be shown, it must match the last canvas.
+    auto stats = lights.getStatistics();
+    for (size_t i = 0; (i < 1000) && (stats.queue_depth || stats.frames_unacknowledged); i++)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      stats = lights.getStatistics();
+    }
+    if (maxDifference(device.shown(), canvas) != 0)
+    {
+      std::cerr << "The device does not show the last canvas." << std::endl;
+      failures++;
+    }
+    if (stats.acks_lost != 0)
+    {
+      std::cerr << "Lost " << stats.acks_lost << " acknowledgements." << std::endl;
+      failures++;
+    }
+
+    std::cout << "Frames: " << frames << " written: " << stats.frames_written << " dropped: " << stats.frames_dropped
+              << " acknowledged: " << stats.frames_acknowledged << " lost: " << stats.acks_lost << std::endl;
+    std::cout << "Latency until shown, p50: " << stats.ack_latency.percentile(0.5)
+              << " usec, p90: " << stats.ack_latency.percentile(0.9)
+              << " usec, p99: " << stats.ack_latency.percentile(0.99)
+              << " usec, avg: " << stats.ack_latency.sum / stats.ack_latency.count << " usec" << std::endl;
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // Write frames as fast as possible to an output, measure the rate at which they are handled.
+  if (std::string(argv[1]) == "throughput")
+  {
+    const std::string output = (argc >= 3) ? argv[2] : "null";
+    const size_t frames = (argc >= 4) ? std::atoi(argv[3]) : 100000;
+    const size_t full_refresh_interval = (argc >= 5) ? std::atoi(argv[4]) : 1;
+
+    Lights lights;
+    if (!lights.connect(output))
+    {
+      return 1;
+    }
+    lights.setDeltaEncoding(0, full_refresh_interval);
+
+    CanvasWalk walk;
+    auto canvas = Lights::makeCanvas();
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+      walk.step(canvas);
+      lights.write(canvas);
+    }
+    while (lights.getStatistics().queue_depth != 0)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+    const auto stats = lights.getStatistics();
+    std::cout << "Frames: " << frames << " in " << duration.count() << " s, " << frames / duration.count()
+              << " frames/s" << std::endl;
+    std::cout << "Written: " << stats.frames_written << " (" << stats.frames_written / duration.count()
+              << " frames/s) unchanged: " << stats.frames_unchanged << " dropped: " << stats.frames_dropped
+              << " errors: " << stats.write_errors << std::endl;
+    std::cout << "Bytes: " << stats.bytes_written << " per written frame: "
+              << (stats.frames_written ? double(stats.bytes_written) / stats.frames_written : 0.0)
+              << " write latency: " << stats.write_latency_us << " usec" << std::endl;
+    return stats.write_errors ? 1 : 0;
+  }
+
+  // Send frames to controllers on loopback, verify they receive the canvas and measure the packet rate.
+  if (std::string(argv[1]) == "udp")
+  {
+    const size_t frames = (argc >= 3) ? std::atoi(argv[2]) : 1000;
+    const size_t batch = (argc >= 4) ? std::atoi(argv[3]) : 0;
+    const size_t leds_per_packet = (argc >= 5) ? std::atoi(argv[4]) : UdpOutput::max_leds_per_packet;
+
+    // Two controllers, the second one drives two segments that are at different offsets on its strip and is reached
+    // over IPv6.
+    namespace ip = boost::asio::ip;
+    boost::asio::io_service receive_io;
+    std::array<ip::udp::socket, 2> receivers{ ip::udp::socket{ receive_io, { ip::address_v4::loopback(), 0 } },
+                                              ip::udp::socket{ receive_io, { ip::address_v6::loopback(), 0 } } };
+    const std::vector<UdpOutput::Segment> segments{
+      { "127.0.0.1", receivers[0].local_endpoint().port(), 0, 114, 0 },
+      { "::1", receivers[1].local_endpoint().port(), 114, 42, 0 },
+      { "::1", receivers[1].local_endpoint().port(), 156, 72, 100 },
+    };
+    std::array<std::vector<RGB>, 2> strips{ std::vector<RGB>(114), std::vector<RGB>(172) };
+    for (auto& receiver : receivers)
+    {
+      receiver.non_blocking(true);
+      receiver.set_option(ip::udp::socket::receive_buffer_size(1 << 20));
+    }
+
+    Lights lights;
+    auto output = std::make_unique<UdpOutput>(lights.ioService(), segments, Lights::ledCount(), batch, leds_per_packet);
+    UdpOutput* udp = output.get();
+    if (!lights.connect(std::move(output)))
+    {
+      return 1;
+    }
+    lights.setLimitFactor(1.0);
+    lights.setFlowControl(1);  // Controllers never acknowledge, this must not hold back any frames.
+
+    CanvasWalk walk;
+    auto canvas = Lights::makeCanvas();
+    size_t failures = 0;
+    size_t pushes = 0;
+
+    // Segments that end beyond the canvas are rejected.
+    try
+    {
+      UdpOutput invalid{ receive_io, { { "127.0.0.1", 4048, 200, 100, 0 } }, Lights::ledCount() };
+      std::cerr << "Segment beyond the canvas was accepted." << std::endl;
+      failures++;
+    }
+    catch (std::runtime_error&)
+    {
+    }
+    size_t malformed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+      walk.step(canvas);
+      lights.write(canvas);
+      while (lights.getStatistics().queue_depth != 0)
+      {
+        std::this_thread::yield();
+      }
+
+      // Receive all datagrams that arrived, decode them into the strips.
+      for (size_t r = 0; r < receivers.size(); r++)
+      {
+        std::array<uint8_t, 1500> datagram;
+        boost::system::error_code error;
+        size_t length = 0;
+        while ((length = receivers[r].receive(boost::asio::buffer(datagram), 0, error)) > 0 && !error)
+        {
+          const size_t offset = (datagram[4] << 24) | (datagram[5] << 16) | (datagram[6] << 8) | datagram[7];
+          const size_t data_length = (datagram[8] << 8) | datagram[9];
+          if (((datagram[0] & 0xC0) != 0x40) || (data_length + UdpOutput::header_size != length) ||
+              (offset % 3) || (data_length % 3) || ((offset + data_length) / 3 > strips[r].size()))
+          {
+            malformed++;
+            continue;
+          }
+          for (size_t i = 0; i < data_length / 3; i++)
+          {
+            const uint8_t* pixel = &datagram[UdpOutput::header_size + i * 3];
+            strips[r][offset / 3 + i] = { pixel[0], pixel[1], pixel[2] };
+          }
+          pushes += datagram[0] & 0x01;
+        }
+      }
+
+      for (const auto& segment : segments)
+      {
+        const auto& strip = strips[segment.port == segments.front().port ? 0 : 1];
+        for (size_t i = 0; i < segment.led_count; i++)
+        {
+          const RGB& expected = canvas[segment.first_led + i];
+          const RGB& received = strip[segment.controller_offset + i];
+          if ((expected.R != received.R) || (expected.G != received.G) || (expected.B != received.B))
+          {
+            failures++;
+            std::cerr << "Frame " << frame << " led " << segment.first_led + i << " differs." << std::endl;
+            break;
+          }
+        }
+      }
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+    const auto stats = udp->getStatistics();
+    std::cout << "Frames: " << stats.frames << " packets: " << stats.packets << " send calls: " << stats.send_calls
+              << " errors: " << stats.send_errors << " pushes: " << pushes << " malformed: " << malformed
+              << std::endl;
+    std::cout << "Packets/s: " << stats.packets / duration.count() << " bytes per frame: "
+              << (stats.frames ? double(stats.bytes) / stats.frames : 0.0) << std::endl;
+    failures += malformed + stats.send_errors + ((pushes == stats.frames * segments.size()) ? 0 : 1);
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  // Check the firmware's interpolator.
+  if (std::string(argv[1]) == "interpolate")
+  {
+    size_t failures = 0;
+    auto check = [&failures](bool condition, const std::string& what) {
+      if (!condition)
+      {
+        std::cerr << "Failed: " << what << std::endl;
+        failures++;
+      }
+    };
+
+    using Interp = Interpolator<4>;
+    Interp interp;
+    check(!interp.update(0), "nothing to do without a keyframe");
+
+    // Without duration the keyframe is reached immediately.
+    interp.setNext(0, 200, 100, 50);
+    interp.setNext(4, 1, 1, 1);  // out of range, ignored.
+    interp.commit(1000, 0);
+    check(interp.update(1000), "update after commit");
+    check(interp.current(0).R == 200 && interp.current(0).G == 100 && interp.current(0).B == 50, "immediate keyframe");
+    check(!interp.update(1001), "done after immediate keyframe");
+
+    // Linear transition towards the next keyframe.
+    interp.setNext(0, 0, 200, 50);
+    interp.commit(2000, 1000);
+    interp.update(2000);
+    check(interp.current(0).R == 200 && interp.current(0).G == 100, "transition starts at current colors");
+    interp.update(2500);
+    check(interp.current(0).R == 100 && interp.current(0).G == 150 && interp.current(0).B == 50, "halfway");
+    uint8_t previous = interp.current(0).R;
+    bool monotonic = true;
+    for (uint32_t t = 2500; t <= 3000; t += 10)
+    {
+      interp.update(t);
+      monotonic &= interp.current(0).R <= previous;
+      previous = interp.current(0).R;
+    }
+    check(monotonic, "monotonic transition");
+    check(interp.current(0).R == 0 && interp.current(0).G == 200, "keyframe reached at the end");
+    check(interp.done() && !interp.update(3100), "done after the transition");
+
+    // Retargeting halfway starts from the intermediate colors.
+    interp.setNext(0, 100, 200, 50);
+    interp.commit(4000, 1000);
+    interp.update(4500);
+    interp.setNext(0, 0, 200, 50);
+    interp.commit(4500, 1000);
+    interp.update(4500);
+    check(interp.current(0).R == 50, "retarget starts at intermediate colors");
+
+    // The microsecond clock wraps around.
+    interp.setNext(0, 200, 200, 50);
+    interp.commit(0xFFFFFF00, 0x200);
+    interp.update(0x00000000);
+    check(interp.current(0).R == 100, "clock wrap around");
+    interp.update(0x00000100);
+    check(interp.current(0).R == 200 && interp.done(), "clock wrap around end");
+
+    // Decay reduces the colors and stops the transition.
+    interp.setNext(0, 255, 255, 255);
+    interp.commit(0, 1000);
+    interp.decay(10);
+    check(interp.current(0).R == 190 && interp.done(), "decay");
+
+    // The emulator drives the same interpolator as the firmware, the fill color is gamma corrected.
+    DeviceEmulator emulator{ Lights::ledCount() };
+    Message msg;
+    msg.type = COLOR;
+    msg.sequence = 0;
+    msg.transition_ms = 0;
+    msg.color.settings = ColorData::settings_show_after | ColorData::settings_set_all;
+    msg.color.color[0] = RGB{ 128, 128, 128 };
+    emulator.process(msg);
+    const RGB filled = emulator.shown().back();
+    check(filled.R == 128 && filled.G < 128 && filled.B < filled.G, "gamma corrected fill");
+
+    // A transition progresses as time passes.
+    msg.transition_ms = 100;
+    msg.color.color[0] = RGB{ 0, 0, 0 };
+    emulator.process(msg);
+    check(emulator.shown().front().R == 128, "emulator transition starts at current colors");
+    emulator.advance(50000);
+    check(emulator.shown().front().R == 64, "emulator transition halfway");
+    emulator.advance(50000);
+    check(emulator.shown().front().R == 0, "emulator transition done");
+
+    // Decay starts after the delay and acts on the colors before gamma.
+    msg.transition_ms = 0;
+    msg.color.color[0] = RGB{ 200, 200, 200 };
+    emulator.process(msg);
+    emulator.advance(999000);
+    check(emulator.shown().front().R == 200, "no decay before the delay");
+    emulator.advance(10000);
+    check(emulator.shown().front().R < 200 && emulator.shown().front().R > 180, "decay after the delay");
+
+    // A transition longer than the decay delay completes, the delay counts from its end.
+    msg.transition_ms = 2000;
+    msg.color.color[0] = RGB{ 0, 0, 0 };
+    emulator.process(msg);
+    emulator.advance(1500000);
+    check(emulator.shown().front().R > 40, "no decay during a long transition");
+    emulator.advance(500000);
+    check(emulator.shown().front().R == 0, "long transition done");
+    msg.transition_ms = 1500;
+    msg.color.color[0] = RGB{ 200, 200, 200 };
+    emulator.process(msg);
+    emulator.advance(2400000);
+    check(emulator.shown().front().R == 200, "no decay before the delay after a transition");
+    emulator.advance(200000);
+    check(emulator.shown().front().R < 200, "decay after the delay after a transition");
+
+    std::cout << "Failures: " << failures << std::endl;
+    return failures ? 1 : 0;
+  }
+
+  return 0;
+}
@@ -17,112 +17,582 @@
   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
   SOFTWARE.
 */
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
 #include "analyzer.h"
 #include "lights.h"
+#include "outputUdp.h"
+#include "pipeline.h"
 #include "pixelsniff.h"
+#include "pixelsniffReplay.h"
+#include "pixelsniffY4M.h"
 #include "platform.h"
+#include "recording.h"
 #include "timing.h"
 #include "config.h"
+#include "configWatcher.h"
+#ifndef WIN32
+#include "controlSocket.h"
+#endif
+#include "metrics.h"
 
 void printHelp(const std::string& progname)
 {
-  std::cout << "" << progname << " serial_port_path [config]" << std::endl;
+  std::cout << "" << progname << " output [config]" << std::endl;
+  std::cout << "  output: path of the serial port, serial:<path>, pty, file:<path>, null, udp or strips" << std::endl;
+  std::cout << "  udp sends to the controllers from the config." << std::endl;
+  std::cout << "  strips drives the strips from the config, each from its own area of the desktop." << std::endl;
+  std::cout << "Options:" << std::endl;
+  std::cout << "  --record <file>          Record the captured frames." << std::endl;
+  std::cout << "  --record-border <depth>  Only record the border strips of this depth." << std::endl;
+  std::cout << "  --replay <file>          Replay a recording or a .y4m video instead of the screen." << std::endl;
+  std::cout << "  --fast                   Replay as fast as possible and print the timing at the end." << std::endl;
+  std::cout << "  --control <socket>       Serve statistics and parameter changes on this socket." << std::endl;
+  std::cout << "  --metrics <file>         Write metrics in the Prometheus text format to this file." << std::endl;
+  std::cout << "  --metrics-interval <s>   Interval between writes of the metrics, default 10 seconds." << std::endl;
+  std::cout << "  --preview <file>         Write the frames with the colors of the boxes drawn on them to a .y4m video."
+            << std::endl;
+  std::cout << "                           A size change starts a numbered file, the header states the nominal rate."
+            << std::endl;
 }
 
-int main(int argc, char* argv[])
+/**
+ * @brief The options from the command line.
+ */
+struct Options
 {
-  // testConfigThing();
-  // return 0;
+  std::vector<std::string> args;  //!< The positional arguments.
+  std::string record_path;        //!< Record the captured frames to this file.
+  size_t record_border{ 0 };      //!< Only record the border strips of this depth.
+  std::string replay_path;        //!< Replay this recording or video instead of the screen.
+  bool replay_fast{ false };      //!< Replay as fast as possible.
+  std::string control_path;       //!< Serve the control socket at this path.
+  std::string metrics_path;       //!< Write the metrics to this file.
+  double metrics_interval{ 10 };  //!< Interval between writes of the metrics, in seconds.
+  std::string preview_path;       //!< Write the preview video to this file.
+};
 
-  PixelSniffer::Ptr sniff = getSniffer();
-  sniff->connect();
-  sniff->selectRootWindow();
+/**
+ * @brief Separate the options from the positional arguments.
+ */
+Options parseOptions(int argc, char* argv[])
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if ((arg == "--record") && (i + 1 < argc))
+    {
+      options.record_path = argv[++i];
+    }
+    else if ((arg == "--record-border") && (i + 1 < argc))
+    {
+      options.record_border = std::atoi(argv[++i]);
+    }
+    else if ((arg == "--replay") && (i + 1 < argc))
+    {
+      options.replay_path = argv[++i];
+    }
+    else if ((arg == "--control") && (i + 1 < argc))
+    {
+      options.control_path = argv[++i];
+    }
+    else if ((arg == "--metrics") && (i + 1 < argc))
+    {
+      options.metrics_path = argv[++i];
+    }
+    else if ((arg == "--metrics-interval") && (i + 1 < argc))
+    {
+      options.metrics_interval = std::atof(argv[++i]);
+    }
+    else if ((arg == "--preview") && (i + 1 < argc))
+    {
+      options.preview_path = argv[++i];
+    }
+    else if (arg == "--fast")
+    {
+      options.replay_fast = true;
+    }
+    else
+    {
+      options.args.push_back(arg);
+    }
+  }
+  return options;
+}
 
-  Lights lights;
-  Analyzer analyzer;
-  DisplayLightConfig config;
+/**
+ * @brief Create the sniffer that captures the screen, or replays a recording or video of it.
+ * @param replay Is assigned the sniffer if it replays.
+ * @throws std::runtime_error if the recording or video can't be opened.
+ */
+PixelSniffer::Ptr makeSniffer(const Options& options, std::shared_ptr<PixelSnifferPlayback>& replay)
+{
+  const std::string& path = options.replay_path;
+  if (path.empty())
+  {
+    return getSniffer();
+  }
+  const std::string extension = ".y4m";
+  const bool video = (path.size() >= extension.size()) &&
+                     (path.compare(path.size() - extension.size(), extension.size(), extension) == 0);
+  if (video)
+  {
+    replay = std::make_shared<PixelSnifferY4M>(path, !options.replay_fast);
+  }
+  else
+  {
+    replay = std::make_shared<PixelSnifferReplay>(path, !options.replay_fast);
+  }
+  return replay;
+}
 
-  std::string path = "COM5";
+/**
+ * @brief Apply the settings of the lights from the config, these can be changed while running.
+ */
+void applyLightsConfig(Lights& lights, const DisplayLightConfig& config)
+{
+  lights.setEncoding(config.compact_colors ? COLOR_RGB565 : COLOR);
+  lights.setFlowControl(config.max_frames_in_flight);
+  // The message carries the duration in 16 bits, longer transitions are clamped.
+  lights.setTransition(static_cast<uint16_t>(std::min<size_t>(config.transition_ms, UINT16_MAX)));
+}
 
-  // Handle help printing
-  if (argc < 2)
+/**
+ * @brief Connect the lights to the output and apply the settings from the config.
+ * @return False if the output could not be connected.
+ */
+bool connectLights(Lights& lights, const std::string& path, const DisplayLightConfig& config)
+{
+  bool connected = false;
+  if (path == "udp")
   {
-    printHelp(argv[0]);
-    return 1;
+    std::vector<UdpOutput::Segment> segments;
+    for (const auto& controller : config.controllers)
+    {
+      segments.push_back({ controller.address, controller.port, controller.first_led, controller.led_count,
+                           controller.controller_offset });
+    }
+    try
+    {
+      connected = lights.connect(
+          std::make_unique<UdpOutput>(lights.ioService(), segments, Lights::ledCount(), config.udp_batch));
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+    }
+  }
+  else
+  {
+    connected = lights.connect(path);
+  }
+  if (!connected)
+  {
+    std::cout << "Failed to connect to " << path << std::endl;
+    return false;
+  }
+  applyLightsConfig(lights, config);
+  return true;
+}
+
+/**
+ * @brief Create the strips with their lights connected, a single strip driven from the entire capture area or each
+ *        strip from the config from its own area.
+ * @return No strips if there are none in the config or an output could not be connected.
+ */
+std::vector<Strip> makeStrips(const std::string& path, const DisplayLightConfig& config)
+{
+  std::vector<Strip> strips;
+  if (path == "strips")
+  {
+    for (const auto& strip_config : config.strips)
+    {
+      strips.emplace_back();
+      strips.back().name = strip_config.output;
+      strips.back().desktop = Box(strip_config.x_offset, strip_config.x_offset + strip_config.width,
+                                  strip_config.y_offset, strip_config.y_offset + strip_config.height);
+    }
+    if (strips.empty())
+    {
+      std::cout << "No strips in the config." << std::endl;
+    }
   }
-  if ((argc >= 2) && (std::string(argv[1]) == "--help"))
+  else
+  {
+    strips.emplace_back();
+    strips.back().name = path;
+  }
+  for (auto& strip : strips)
+  {
+    strip.lights = std::make_unique<Lights>();
+    if (!connectLights(*strip.lights, strip.name, config))
+    {
+      return {};
+    }
+  }
+  return strips;
+}
+
+/**
+ * @brief Prepare the capture for a resolution of the desktop. Multiple strips capture the area spanning all of them
+ *        once, each strip analyzes its own part of it. A single strip captures the area of the applicable region
+ *        config.
+ */
+void prepareCapture(PixelSniffer& sniff, std::vector<Strip>& strips, bool multiple, const DisplayLightConfig& config,
+                    const PixelSniffer::Resolution& resolution)
+{
+  std::cout << "New res: " << resolution.first << " x " << resolution.second << std::endl;
+  if (!multiple)
+  {
+    auto regionconfig = config.getApplicable(resolution.first, resolution.second);
+    std::cout << "Detected dimension change, applicable config: " << regionconfig.name << std::endl;
+    sniff.prepareCapture(regionconfig.x_offset, regionconfig.y_offset, regionconfig.width, regionconfig.height);
+    return;
+  }
+
+  const Box desktop(0, resolution.first, 0, resolution.second);
+  Box span;
+  for (const auto& strip : strips)
+  {
+    const Box area = strip.desktop.intersection(desktop);
+    if (area.width() && area.height())
+    {
+      span = span.width() ? Box(std::min(span.x_min, area.x_min), std::max(span.x_max, area.x_max),
+                                std::min(span.y_min, area.y_min), std::max(span.y_max, area.y_max)) :
+                            area;
+    }
+  }
+  std::cout << "Capturing " << std::string(span) << " for " << strips.size() << " strips" << std::endl;
+  sniff.prepareCapture(span.x_min, span.y_min, span.width(), span.height());
+  for (auto& strip : strips)
+  {
+    const Box area = strip.desktop.intersection(span);
+    strip.capture = (area.width() && area.height()) ? Box(area.x_min - span.x_min, area.x_max - span.x_min,
+                                                          area.y_min - span.y_min, area.y_max - span.y_min) :
+                                                      Box{};
+  }
+}
+
+/**
+ * @brief Create the rate controller for the config, it adapts the rate to the motion on the screen or runs at the
+ *        fixed frame rate if the minimum is not set.
+ * @param hz The rate to start at.
+ */
+RateController makeRateController(const DisplayLightConfig& config, double hz)
+{
+  RateController::Settings settings{ config.frame_rate_min, config.frame_rate_max, config.motion_low,
+                                     config.motion_high, config.motion_hold_ms };
+  if (config.frame_rate_min <= 0)
+  {
+    settings.min_hz = config.frame_rate;
+    settings.max_hz = config.frame_rate;
+  }
+  return RateController{ settings, hz };
+}
+
+/**
+ * @brief Apply a reloaded config between frames. The outputs stay connected, a change to them requires a restart.
+ *        Only what depends on the keys that changed is rebuilt, the adapted rate and density are kept otherwise.
+ * @return The parts of the processing that changed.
+ */
+ConfigChanges applyReload(DisplayLightConfig& config, DisplayLightConfig reloaded, PixelSniffer& sniff,
+                          RateController& rate, StripPipeline& pipeline)
+{
+  std::cout << "Config changed, applying it." << std::endl;
+  bool outputs_changed = (reloaded.controllers.size() != config.controllers.size());
+  outputs_changed |= (reloaded.strips.size() != config.strips.size()) || (reloaded.udp_batch != config.udp_batch);
+  for (size_t i = 0; !outputs_changed && (i < config.strips.size()); i++)
+  {
+    outputs_changed = (reloaded.strips[i].output != config.strips[i].output);
+  }
+  for (size_t i = 0; !outputs_changed && (i < config.controllers.size()); i++)
+  {
+    outputs_changed = (std::string(reloaded.controllers[i]) != std::string(config.controllers[i]));
+  }
+  if (outputs_changed)
+  {
+    // Keep using the connected outputs.
+    std::cout << "The outputs changed, this requires a restart." << std::endl;
+    reloaded.strips = config.strips;
+    reloaded.controllers = config.controllers;
+    reloaded.udp_batch = config.udp_batch;
+  }
+
+  const ConfigChanges changes = compareConfigs(config, reloaded);
+  config = reloaded;
+  sniff.setDamageTracking(config.damage_tracking);
+  if (changes.rate)
+  {
+    rate = makeRateController(config, rate.rate());
+  }
+  pipeline.applyConfig(changes);
+  for (auto& strip : pipeline.strips())
+  {
+    applyLightsConfig(*strip.lights, config);
+  }
+  return changes;
+}
+
+/**
+ * @brief Apply the changes requested through the control socket.
+ * @return True if the next frame has to be processed, even if it is identical to the previous one.
+ */
+bool applyTuning(Tuning& tuning, DisplayLightConfig& config, RateController& rate, StripPipeline& pipeline)
+{
+  bool process = false;
+  double brightness = 0;
+  if (Tuning::take(tuning.brightness, brightness))
+  {
+    for (auto& strip : pipeline.strips())
+    {
+      strip.lights->setLimitFactor(brightness);
+    }
+    process = true;
+  }
+  if (Tuning::take(tuning.frame_rate, config.frame_rate))
+  {
+    // Pin the rate, adapting it to the motion would move away from the requested rate right away.
+    config.frame_rate_min = 0;
+    rate = makeRateController(config, config.frame_rate);
+  }
+  if (Tuning::take(tuning.sample_distance, config.sample_distance))
+  {
+    pipeline.resetSamples();
+    process = true;
+  }
+  return process;
+}
+
+/**
+ * @brief Skip a frame because the screen didn't change, the last colors are written to keep the lights refreshed.
+ */
+void skipFrame(StripPipeline& pipeline, PreviewWriter* preview, RateController& rate, Metrics& metrics)
+{
+  rate.update(pipeline.colors());
+  pipeline.repeat();
+  if (preview)
+  {
+    preview->repeat();
+  }
+  metrics.frames_skipped++;
+  metrics.rate.store(rate.rate(), std::memory_order_relaxed);
+}
+
+int main(int argc, char* argv[])
+{
+  // testConfigThing();
+  // return 0;
+
+  const Options options = parseOptions(argc, argv);
+  if (options.args.empty() || (options.args.front() == "--help"))
   {
     printHelp(argv[0]);
     return 1;
   }
 
-  // set the path
-  if (argc >= 2)
+  // Capture the screen, or replay a recording of it.
+  PixelSniffer::Ptr sniff;
+  std::shared_ptr<PixelSnifferPlayback> replay;
+  std::unique_ptr<Recorder> recorder;
+  try
   {
-    path = argv[1];
+    sniff = makeSniffer(options, replay);
+    if (!options.record_path.empty())
+    {
+      recorder = std::make_unique<Recorder>(options.record_path, options.record_border);
+    }
   }
-  // load the config
-  if (argc >= 3)
+  catch (std::exception& e)
   {
-    config = DisplayLightConfig::load(argv[2]);
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
   }
+  sniff->connect();
+  sniff->selectRootWindow();
 
-  Limiter limiter{ config.frame_rate };
+  DisplayLightConfig config;
+  if (options.args.size() >= 2)
+  {
+    config = DisplayLightConfig::load(options.args[1]);
+  }
+  sniff->setDamageTracking(config.damage_tracking);
+  RateController rate = makeRateController(config, config.frame_rate);
 
-  // Try to connect to the provided serial port.
-  if (!lights.connect(path))
+  // Apply changes to the config while running.
+  std::unique_ptr<ConfigWatcher> watcher;
+  if (options.args.size() >= 2)
   {
-    std::cout << "Failed to connect to " << path << std::endl;
-    return 1;
+    try
+    {
+      watcher = std::make_unique<ConfigWatcher>(options.args[1]);
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "Not reloading the config: " << e.what() << std::endl;
+    }
   }
 
-  const size_t distance_between_sample_pixels{ 15 };
+  const bool multiple = (options.args[0] == "strips");
+  std::vector<Strip> strips = makeStrips(options.args[0], config);
+  if (strips.empty())
+  {
+    return 1;
+  }
+  Metrics metrics;
+  StripPipeline pipeline(std::move(strips), multiple, config, metrics);
 
-  // Create the canvas
-  std::vector<RGB> canvas{ lights.ledCount(), { 0, 0, 0 } };
+  // Serve the control socket from its own thread, it only shares atomics with the frame loop.
+  Tuning tuning;
+#ifndef WIN32
+  std::unique_ptr<ControlSocket> control;
+  if (!options.control_path.empty())
+  {
+    std::vector<const Lights*> lights;
+    for (const auto& strip : pipeline.strips())
+    {
+      lights.push_back(strip.lights.get());
+    }
+    try
+    {
+      control = std::make_unique<ControlSocket>(options.control_path, metrics, tuning, lights);
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+#endif
+  std::unique_ptr<MetricsWriter> metrics_writer;
+  if (!options.metrics_path.empty())
+  {
+    MetricsWriter::NamedLights lights;
+    for (const auto& strip : pipeline.strips())
+    {
+      lights.emplace_back(strip.name, strip.lights.get());
+    }
+    metrics_writer = std::make_unique<MetricsWriter>(options.metrics_path, options.metrics_interval, metrics, lights);
+  }
+  std::unique_ptr<PreviewWriter> preview;
+  if (!options.preview_path.empty())
+  {
+    preview = std::make_unique<PreviewWriter>(options.preview_path);
+  }
 
-  Box sample_bounds;
-  std::vector<BoxSamples> sample_points;
-  // sniff.prepareCapture(x, y, w, h);
   PixelSniffer::Resolution current_res;
-
+  const auto start = std::chrono::steady_clock::now();
+  Measure work;
+  Measure stage;
+  std::vector<Box> damage;
+  uint64_t last_fingerprint = 0;
+  bool fingerprint_known = false;  // Cleared when the next frame has to be processed, even if it is identical.
+  auto last_processed = std::chrono::steady_clock::now();
   while (1)
   {
-    // Rate limit the loop.
-    limiter.sleep();
+    // Rate limit the loop, unless a recording is replayed as fast as possible.
+    if (!(replay && options.replay_fast))
+    {
+      rate.sleep();
+    }
+
+    DisplayLightConfig reloaded;
+    if (watcher && watcher->poll(reloaded))
+    {
+      if (applyReload(config, reloaded, *sniff, rate, pipeline).capture)
+      {
+        current_res = PixelSniffer::Resolution{};  // Prepares the capture area and the sample points again.
+      }
+      fingerprint_known = false;
+    }
+    if (applyTuning(tuning, config, rate, pipeline))
+    {
+      fingerprint_known = false;
+    }
+
+    // The resolution is cached by the sniffer, this is cheap.
+    const auto full_res = sniff->getFullResolution();
+    if (current_res != full_res)
+    {
+      current_res = full_res;
+      prepareCapture(*sniff, pipeline.strips(), multiple, config, current_res);
+      pipeline.resetSamples();  // The entire area is captured again, prepare the regions for the new bounds.
+      fingerprint_known = false;
+    }
+
+    // Skip the capture if the screen didn't change.
+    const bool damage_known = config.damage_tracking && sniff->getDamage(damage);
+    if (damage_known && damage.empty())
+    {
+      skipFrame(pipeline, preview.get(), rate, metrics);
+      continue;
+    }
 
     // Grab the contents of the screen.
+    stage.start();
     bool success = sniff->grabContent();
+    metrics.add(Metrics::STAGE_CAPTURE, stage.stop());
     if (!success)
     {
+      metrics.capture_failures++;
+      if (replay && replay->finished())
+      {
+        break;
+      }
       // This happens on timeout in windows... just delay 1 millisecond and try again.
       std::this_thread::sleep_for(std::chrono::milliseconds(1));
       continue;
     }
-    const auto image = sniff->getScreen();
-
-    const Box bounds = analyzer.findBorders(*image);
-    if (!(bounds == sample_bounds))
+    work.start();
+    auto image = sniff->getScreen();
+    if (recorder)
     {
-      sample_points = analyzer.makeBoxSamples(distance_between_sample_pixels, bounds);
-      sample_bounds = bounds;
+      const auto timestamp =
+          std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      recorder->add(*image, timestamp.count(), full_res.first, full_res.second);
     }
-    analyzer.sample(*image, bounds, sample_points, canvas);
-    lights.write(canvas);
 
+    // Skip the analysis if the frame is identical to the previous one. An identical frame is still processed now and
+    // then, in case the probes missed a change.
+    const auto now = std::chrono::steady_clock::now();
+    if (config.skip_identical_ms)
+    {
+      const uint64_t fingerprint = Analyzer::fingerprint(*image);
+      const bool identical = fingerprint_known && (fingerprint == last_fingerprint);
+      last_fingerprint = fingerprint;
+      fingerprint_known = true;
+      if (identical && (now - last_processed < std::chrono::milliseconds(config.skip_identical_ms)))
+      {
+        skipFrame(pipeline, preview.get(), rate, metrics);
+        continue;
+      }
+    }
+    last_processed = now;
 
-    if (current_res != sniff->getFullResolution())
+    pipeline.process(image, *sniff, damage_known ? &damage : nullptr);
+    rate.update(pipeline.colors());
+    work.stop();
+    if (preview)
     {
-      // Check which one applies.
-      current_res = sniff->getFullResolution();
-      std::cout << "New res: " << current_res.first << " x " << current_res.second << std::endl;
-      auto regionconfig = config.getApplicable(current_res.first, current_res.second);
-      std::cout << "Detected dimension change, applicable config: " << regionconfig.name << std::endl;
-      sniff->prepareCapture(regionconfig.x_offset, regionconfig.y_offset, regionconfig.width, regionconfig.height);
+      preview->write(*image, pipeline.strips(), pipeline.colors(), rate.rate());
     }
+    metrics.frames++;
+    metrics.rate.store(rate.rate(), std::memory_order_relaxed);
+  }
+
+  // Only reached at the end of a replay.
+  std::cout << "Frames: " << replay->grabbed() << " avg: " << work.average() << " usec"
+            << " rate: " << rate.rate() << " hz"
+            << " skipped: " << metrics.frames_skipped << std::endl;
+  for (const auto& strip : pipeline.strips())
+  {
+    const auto stats = strip.lights->getStatistics();
+    std::cout << strip.name << " written: " << stats.frames_written << " dropped: " << stats.frames_dropped
+              << " unchanged: " << stats.frames_unchanged << " bytes: " << stats.bytes_written << std::endl;
   }
+  return 0;
 }
@@ -0,0 +1,167 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "metrics.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+MetricsWriter::MetricsWriter(const std::string& filename, double interval_s, const Metrics& metrics,
+                             NamedLights lights)
+  : filename_(filename), interval_s_(interval_s), metrics_(metrics), lights_(std::move(lights))
+{
+  thread_ = std::thread([this]() { run(); });
+}
+
+MetricsWriter::~MetricsWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  condition_.notify_all();
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+/**
+ * @brief Write the header of a metric.
+ */
+static void metricHeader(std::ostream& os, const std::string& name, const std::string& type, const std::string& help)
+{
+  os << "# HELP " << name << " " << help << "\n";
+  os << "# TYPE " << name << " " << type << "\n";
+}
+
+std::string MetricsWriter::format(double achieved_rate) const
+{
+  std::stringstream ss;
+  metricHeader(ss, "displaylight_frames_total", "counter", "Frames processed.");
+  ss << "displaylight_frames_total " << metrics_.frames << "\n";
+  metricHeader(ss, "displaylight_frames_skipped_total", "counter", "Frames skipped, unchanged since the previous.");
+  ss << "displaylight_frames_skipped_total " << metrics_.frames_skipped << "\n";
+  metricHeader(ss, "displaylight_frames_skipped_ratio", "gauge", "Fraction of the frames that were skipped.");
+  ss << "displaylight_frames_skipped_ratio " << metrics_.skipRatio() << "\n";
+  metricHeader(ss, "displaylight_frame_rate_target_hz", "gauge", "Rate the frame loop runs at.");
+  ss << "displaylight_frame_rate_target_hz " << metrics_.rate << "\n";
+  metricHeader(ss, "displaylight_frame_rate_achieved_hz", "gauge", "Rate achieved since the previous write.");
+  ss << "displaylight_frame_rate_achieved_hz " << achieved_rate << "\n";
+  metricHeader(ss, "displaylight_capture_failures_total", "counter", "Grabs of the screen that failed.");
+  ss << "displaylight_capture_failures_total " << metrics_.capture_failures << "\n";
+  metricHeader(ss, "displaylight_bounds_changes_total", "counter", "Frames in which the bounds of a strip moved.");
+  ss << "displaylight_bounds_changes_total " << metrics_.bounds_changes << "\n";
+  metricHeader(ss, "displaylight_boxes_sampled_total", "counter", "Boxes sampled, unchanged boxes may be skipped.");
+  ss << "displaylight_boxes_sampled_total " << metrics_.boxes_sampled << "\n";
+  metricHeader(ss, "displaylight_boxes_sampled", "gauge", "Boxes sampled in the last frame.");
+  ss << "displaylight_boxes_sampled " << metrics_.boxes_sampled_last << "\n";
+  metricHeader(ss, "displaylight_samples_per_box", "gauge", "Sample points per box picked for the sample budget.");
+  ss << "displaylight_samples_per_box " << metrics_.samples_per_box << "\n";
+  metricHeader(ss, "displaylight_plan_rebuilds_total", "counter", "Times sample points or a sample plan were made.");
+  ss << "displaylight_plan_rebuilds_total " << metrics_.plan_rebuilds << "\n";
+
+  // The buckets are cumulative, the last bucket of the histogram also holds everything beyond it.
+  metricHeader(ss, "displaylight_stage_duration_seconds", "histogram", "Duration of each stage of a frame.");
+  for (size_t stage = 0; stage < Metrics::STAGE_COUNT; stage++)
+  {
+    const auto& timing = metrics_.stages[stage];
+    const std::string label = std::string("stage=\"") + Metrics::stageName(stage) + "\"";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < Histogram::bucket_count - 1; i++)
+    {
+      cumulative += timing.buckets[i].load(std::memory_order_relaxed);
+      ss << "displaylight_stage_duration_seconds_bucket{" << label << ",le=\"" << Histogram::upperBound(i) / 1e6
+         << "\"} " << cumulative << "\n";
+    }
+    cumulative += timing.buckets[Histogram::bucket_count - 1].load(std::memory_order_relaxed);
+    ss << "displaylight_stage_duration_seconds_bucket{" << label << ",le=\"+Inf\"} " << cumulative << "\n";
+    ss << "displaylight_stage_duration_seconds_sum{" << label << "} " << timing.total_us / 1e6 << "\n";
+    ss << "displaylight_stage_duration_seconds_count{" << label << "} " << cumulative << "\n";
+  }
+
+  // Statistics of the outputs.
+  std::vector<Lights::Statistics> stats;
+  for (const auto& lights : lights_)
+  {
+    stats.push_back(lights.second->getStatistics());
+  }
+  auto output = [&](const std::string& name, const std::string& type, const std::string& help, auto field) {
+    metricHeader(ss, name, type, help);
+    for (size_t i = 0; i < lights_.size(); i++)
+    {
+      ss << name << "{output=\"" << lights_[i].first << "\"} " << field(stats[i]) << "\n";
+    }
+  };
+  output("displaylight_output_frames_written_total", "counter", "Frames written to the output.",
+         [](const Lights::Statistics& s) { return s.frames_written; });
+  output("displaylight_output_frames_dropped_total", "counter", "Frames replaced by a newer one before being written.",
+         [](const Lights::Statistics& s) { return s.frames_dropped; });
+  output("displaylight_output_write_errors_total", "counter", "Writes to the output that failed.",
+         [](const Lights::Statistics& s) { return s.write_errors; });
+  output("displaylight_output_bytes_written_total", "counter", "Bytes written to the output.",
+         [](const Lights::Statistics& s) { return s.bytes_written; });
+  output("displaylight_output_write_latency_seconds", "gauge", "Average duration of a write to the output.",
+         [](const Lights::Statistics& s) { return s.write_latency_us / 1e6; });
+  return ss.str();
+}
+
+bool MetricsWriter::write(double achieved_rate) const
+{
+  const std::string temporary = filename_ + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::trunc);
+    out << format(achieved_rate);
+    if (!out)
+    {
+      return false;
+    }
+  }
+#ifdef WIN32
+  std::remove(filename_.c_str());  // Rename doesn't replace an existing file here.
+#endif
+  return std::rename(temporary.c_str(), filename_.c_str()) == 0;
+}
+
+void MetricsWriter::run()
+{
+  auto previous_time = std::chrono::steady_clock::now();
+  uint64_t previous_frames = metrics_.frames + metrics_.frames_skipped;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_)
+  {
+    condition_.wait_for(lock, std::chrono::duration<double>(interval_s_), [this]() { return !running_; });
+    if (!running_)
+    {
+      break;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t frames = metrics_.frames + metrics_.frames_skipped;
+    const double elapsed = std::chrono::duration<double>(now - previous_time).count();
+    const double achieved_rate = (elapsed > 0) ? (frames - previous_frames) / elapsed : 0.0;
+    previous_time = now;
+    previous_frames = frames;
+    if (!write(achieved_rate))
+    {
+      std::cerr << "Failed to write metrics to " << filename_ << std::endl;
+    }
+  }
+}
@@ -0,0 +1,152 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "lights.h"
+#include "timing.h"
+
+/**
+ * @brief Counters and timings of the frame loop. The frame loop only increments them, readers on other threads see
+ *        them without taking a lock.
+ */
+struct Metrics
+{
+  /**
+   * @brief The stages of a frame.
+   */
+  enum Stage
+  {
+    STAGE_CAPTURE,  //!< Grabbing the screen.
+    STAGE_BORDERS,  //!< Finding the borders and preparing the sample points.
+    STAGE_SAMPLE,   //!< Sampling the boxes.
+    STAGE_OUTPUT,   //!< Handing the colors to the lights.
+    STAGE_COUNT
+  };
+
+  /**
+   * @brief Return the name of a stage.
+   */
+  static const char* stageName(size_t stage)
+  {
+    static const char* names[STAGE_COUNT] = { "capture", "borders", "sample", "output" };
+    return names[stage];
+  }
+
+  /**
+   * @brief Accumulated durations of a stage, with the buckets of a Histogram.
+   */
+  struct Timing
+  {
+    std::atomic<uint64_t> count{ 0 };                                      //!< Number of durations.
+    std::atomic<uint64_t> total_us{ 0 };                                   //!< Sum of the durations, in microseconds.
+    std::array<std::atomic<uint64_t>, Histogram::bucket_count> buckets{};  //!< Number of durations in each bucket.
+  };
+
+  std::array<Timing, STAGE_COUNT> stages;         //!< Timings of each stage.
+  std::atomic<uint64_t> frames{ 0 };              //!< Frames that were processed.
+  std::atomic<uint64_t> frames_skipped{ 0 };      //!< Frames without damage or identical to the previous one.
+  std::atomic<uint64_t> capture_failures{ 0 };    //!< Grabs of the screen that failed.
+  std::atomic<uint64_t> bounds_changes{ 0 };      //!< Frames in which the bounds of a strip moved.
+  std::atomic<uint64_t> boxes_sampled{ 0 };       //!< Boxes that were sampled, in all frames.
+  std::atomic<uint64_t> boxes_sampled_last{ 0 };  //!< Boxes that were sampled in the last frame.
+  std::atomic<uint64_t> samples_per_box{ 0 };     //!< Sample points per box picked for the budget, 0 if not used.
+  std::atomic<uint64_t> plan_rebuilds{ 0 };       //!< Times sample points or a sample plan were made again.
+  std::atomic<double> rate{ 0 };                  //!< The current rate of the frame loop, in hz.
+
+  /**
+   * @brief Add a duration in microseconds to a stage.
+   */
+  void add(Stage stage, double duration_us)
+  {
+    stages[stage].count.fetch_add(1, std::memory_order_relaxed);
+    stages[stage].total_us.fetch_add(static_cast<uint64_t>(duration_us), std::memory_order_relaxed);
+    stages[stage].buckets[Histogram::bucketIndex(duration_us)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Return the fraction of the frames that were skipped because they were identical to the previous one.
+   */
+  double skipRatio() const
+  {
+    const uint64_t skipped = frames_skipped;
+    const uint64_t total = frames + skipped;
+    return total ? static_cast<double>(skipped) / total : 0.0;
+  }
+};
+
+/**
+ * @brief Periodically writes the metrics and the statistics of the lights to a file in the Prometheus text format, for
+ *        example for the textfile collector of the node exporter. The file is replaced atomically by writing to a
+ *        temporary file first. This runs on a thread of its own, it only reads the atomics of the metrics.
+ */
+class MetricsWriter
+{
+public:
+  using NamedLights = std::vector<std::pair<std::string, const Lights*>>;
+
+  /**
+   * @brief Start writing the metrics.
+   * @param filename The file to write.
+   * @param interval_s The interval between writes, in seconds.
+   * @param metrics The metrics of the frame loop.
+   * @param lights The lights of which the statistics are written, labelled with their name.
+   */
+  MetricsWriter(const std::string& filename, double interval_s, const Metrics& metrics, NamedLights lights);
+  ~MetricsWriter();
+
+  /**
+   * @brief Return the metrics in the Prometheus text format.
+   * @param achieved_rate The rate the frame loop achieved since the previous write, in hz.
+   */
+  std::string format(double achieved_rate) const;
+
+  /**
+   * @brief Write the metrics to the file.
+   * @return False if the file could not be written.
+   */
+  bool write(double achieved_rate) const;
+
+private:
+  std::string filename_;               //!< The file to write.
+  double interval_s_;                  //!< Interval between writes.
+  const Metrics& metrics_;             //!< The metrics of the frame loop.
+  NamedLights lights_;                 //!< The lights and their names.
+  bool running_{ true };               //!< Cleared to stop the thread.
+  std::mutex mutex_;                   //!< Protects running_.
+  std::condition_variable condition_;  //!< Wakes the thread to stop.
+  std::thread thread_;                 //!< Thread writing the file.
+
+  /**
+   * @brief Write the file each interval until stopped.
+   */
+  void run();
+};
+
+#endif
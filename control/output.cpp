@@ -0,0 +1,182 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "output.h"
+#include <iostream>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <array>
+#endif
+
+Output::Ptr Output::create(boost::asio::io_service& io, const std::string& spec, size_t baudrate)
+{
+  try
+  {
+    if (spec == "null")
+    {
+      return std::make_unique<NullOutput>(io);
+    }
+#ifndef WIN32
+    if (spec == "pty")
+    {
+      auto output = std::make_unique<PseudoTerminalOutput>(io);
+      std::cout << "Writing to pseudo terminal: " << output->path() << std::endl;
+      return Ptr{ std::move(output) };
+    }
+#endif
+    if (spec.find("file:") == 0)
+    {
+      return std::make_unique<FileOutput>(io, spec.substr(5));
+    }
+    if (spec.find("serial:") == 0)
+    {
+      return std::make_unique<SerialOutput>(io, spec.substr(7), baudrate);
+    }
+    return std::make_unique<SerialOutput>(io, spec, baudrate);
+  }
+  catch (std::runtime_error& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return nullptr;
+  }
+}
+
+bool Output::acknowledges() const
+{
+  // Files, the null output and networked controllers never answer.
+  return false;
+}
+
+SerialOutput::SerialOutput(boost::asio::io_service& io, const std::string& path, size_t baudrate) : serial_(io, path)
+{
+  serial_.set_option(boost::asio::serial_port_base::baud_rate(baudrate));
+}
+
+void SerialOutput::asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler)
+{
+  boost::asio::async_write(serial_, buffers, handler);
+}
+
+void SerialOutput::asyncRead(boost::asio::mutable_buffer buffer, Handler handler)
+{
+  boost::asio::async_read(serial_, boost::asio::buffer(buffer), handler);
+}
+
+bool SerialOutput::acknowledges() const
+{
+  return true;
+}
+
+#ifndef WIN32
+PseudoTerminalOutput::PseudoTerminalOutput(boost::asio::io_service& io) : master_(io)
+{
+  int master = -1;
+  std::array<char, 256> name;
+  termios raw;
+  cfmakeraw(&raw);
+  if (openpty(&master, &slave_, name.data(), &raw, nullptr) != 0)
+  {
+    throw std::runtime_error("Failed to open pseudo terminal.");
+  }
+  master_.assign(master);
+  path_ = name.data();
+}
+
+PseudoTerminalOutput::~PseudoTerminalOutput()
+{
+  close(slave_);
+}
+
+void PseudoTerminalOutput::asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler)
+{
+  boost::asio::async_write(master_, buffers, handler);
+}
+
+void PseudoTerminalOutput::asyncRead(boost::asio::mutable_buffer buffer, Handler handler)
+{
+  boost::asio::async_read(master_, boost::asio::buffer(buffer), handler);
+}
+
+bool PseudoTerminalOutput::acknowledges() const
+{
+  return true;
+}
+
+const std::string& PseudoTerminalOutput::path() const
+{
+  return path_;
+}
+#endif
+
+FileOutput::FileOutput(boost::asio::io_service& io, const std::string& path)
+  : io_(io), file_(path, std::ios::binary | std::ios::trunc)
+{
+  if (!file_)
+  {
+    throw std::runtime_error("Failed to open " + path);
+  }
+}
+
+void FileOutput::asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler)
+{
+  // Regular files can't be written asynchronously, the write happens on the io thread so this is still off the
+  // thread that calls Lights::write().
+  size_t written = 0;
+  for (const auto& buffer : buffers)
+  {
+    file_.write(static_cast<const char*>(buffer.data()), buffer.size());
+    written += buffer.size();
+  }
+  boost::system::error_code error;
+  if (!file_)
+  {
+    error = boost::asio::error::broken_pipe;
+  }
+  io_.post([handler, error, written]() { handler(error, written); });
+}
+
+void FileOutput::asyncRead(boost::asio::mutable_buffer, Handler)
+{
+  // A file never acknowledges anything.
+}
+
+NullOutput::NullOutput(boost::asio::io_service& io) : io_(io)
+{
+}
+
+void NullOutput::asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler)
+{
+  const size_t written = boost::asio::buffer_size(buffers);
+  bytes_ += written;
+  io_.post([handler, written]() { handler(boost::system::error_code{}, written); });
+}
+
+void NullOutput::asyncRead(boost::asio::mutable_buffer, Handler)
+{
+  // Nothing is ever received.
+}
+
+size_t NullOutput::bytes() const
+{
+  return bytes_;
+}
@@ -0,0 +1,145 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <boost/asio.hpp>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The byte stream that Lights writes its messages to and reads acknowledgements from. All operations are
+ *        asynchronous and their handlers run on the io service the output was created with.
+ */
+class Output
+{
+public:
+  using Ptr = std::unique_ptr<Output>;
+  using Handler = std::function<void(const boost::system::error_code&, std::size_t)>;
+
+  virtual ~Output() = default;
+
+  /**
+   * @brief Create an output from a specification.
+   * @param io The io service that runs the handlers.
+   * @param spec One of "null", "pty", "file:<path>" or "serial:<path>", anything else is used as serial port path.
+   * @param baudrate The baudrate to use in case of a serial port.
+   * @return The output, or nullptr in case an error occured.
+   */
+  static Ptr create(boost::asio::io_service& io, const std::string& spec, size_t baudrate);
+
+  /**
+   * @brief Write all buffers, the handler is called once everything is written or an error occured. The buffers must
+   *        stay valid until then, only one write may be in progress at a time.
+   */
+  virtual void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler) = 0;
+
+  /**
+   * @brief Read exactly the size of the buffer. Outputs that never produce data never call the handler.
+   */
+  virtual void asyncRead(boost::asio::mutable_buffer buffer, Handler handler) = 0;
+
+  /**
+   * @brief Return true if whatever is on the other side acknowledges the frames it showed. Lights only requests
+   *        acknowledgements and applies flow control on outputs that do.
+   */
+  virtual bool acknowledges() const;
+};
+
+/**
+ * @brief Output to the serial port of the device.
+ */
+class SerialOutput : public Output
+{
+public:
+  SerialOutput(boost::asio::io_service& io, const std::string& path, size_t baudrate);
+  void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler) override;
+  void asyncRead(boost::asio::mutable_buffer buffer, Handler handler) override;
+  bool acknowledges() const override;
+
+private:
+  boost::asio::serial_port serial_;  //!< The serial port.
+};
+
+#ifndef WIN32
+/**
+ * @brief Output to a newly created pseudo terminal pair, the slave side behaves like the serial port of a device and
+ *        can be opened by anything that stands in for the device.
+ */
+class PseudoTerminalOutput : public Output
+{
+public:
+  PseudoTerminalOutput(boost::asio::io_service& io);
+  ~PseudoTerminalOutput();
+  void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler) override;
+  void asyncRead(boost::asio::mutable_buffer buffer, Handler handler) override;
+  bool acknowledges() const override;
+
+  /**
+   * @brief Return the path of the slave side of the pseudo terminal.
+   */
+  const std::string& path() const;
+
+private:
+  boost::asio::posix::stream_descriptor master_;  //!< The side that is written to.
+  int slave_{ -1 };                               //!< Kept open such that the pair persists while nobody has it open.
+  std::string path_;                              //!< Path of the slave side.
+};
+#endif
+
+/**
+ * @brief Output that dumps all bytes into a file, the messages are written back to back.
+ */
+class FileOutput : public Output
+{
+public:
+  FileOutput(boost::asio::io_service& io, const std::string& path);
+  void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler) override;
+  void asyncRead(boost::asio::mutable_buffer buffer, Handler handler) override;
+
+private:
+  boost::asio::io_service& io_;  //!< The io service on which the handlers are called.
+  std::ofstream file_;           //!< The file written to.
+};
+
+/**
+ * @brief Output that discards everything and only counts the bytes, to measure the throughput of the host side.
+ */
+class NullOutput : public Output
+{
+public:
+  NullOutput(boost::asio::io_service& io);
+  void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler) override;
+  void asyncRead(boost::asio::mutable_buffer buffer, Handler handler) override;
+
+  /**
+   * @brief Return the number of bytes that were written.
+   */
+  size_t bytes() const;
+
+private:
+  boost::asio::io_service& io_;  //!< The io service on which the handlers are called.
+  size_t bytes_{ 0 };            //!< Number of bytes written.
+};
+
+#endif
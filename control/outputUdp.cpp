@@ -0,0 +1,239 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "outputUdp.h"
+#include <algorithm>
+
+UdpOutput::UdpOutput(boost::asio::io_service& io, const std::vector<Segment>& segments, size_t led_count,
+                     size_t batch, size_t leds_per_packet)
+  : io_(io), socket_v4_(io), socket_v6_(io), batch_(batch)
+{
+  if ((leds_per_packet == 0) || (leds_per_packet > max_leds_per_packet))
+  {
+    throw std::runtime_error("Invalid number of leds per packet.");
+  }
+  if (segments.empty())
+  {
+    throw std::runtime_error("No controllers to send to.");
+  }
+
+  boost::asio::ip::udp::resolver resolver(io);
+  size_t led_end = 0;
+  for (const auto& segment : segments)
+  {
+    if (segment.first_led + segment.led_count > led_count)
+    {
+      throw std::runtime_error("The leds of controller " + segment.address + " end at " +
+                               std::to_string(segment.first_led + segment.led_count) + ", there are only " +
+                               std::to_string(led_count) + " leds.");
+    }
+    const auto destination = *resolver.resolve({ segment.address, std::to_string(segment.port) });
+    auto& socket = socketFor(destination.endpoint().protocol());
+
+    // Split the segment into as few datagrams as possible.
+    for (size_t led = 0; led < segment.led_count; led += leds_per_packet)
+    {
+      const size_t count = std::min(leds_per_packet, segment.led_count - led);
+      const size_t data_offset = (segment.controller_offset + led) * 3;
+      const size_t data_length = count * 3;
+      const bool last = led + count == segment.led_count;
+
+      Packet packet;
+      packet.header[0] = 0x40 | (last ? 0x01 : 0x00);  // Version 1, push on the last packet of the segment.
+      packet.header[1] = 0;                            // Sequence, set for each frame.
+      packet.header[2] = 0x0B;                         // RGB, 8 bits per channel.
+      packet.header[3] = 0x01;                         // Output device 1, the default.
+      packet.header[4] = data_offset >> 24;
+      packet.header[5] = data_offset >> 16;
+      packet.header[6] = data_offset >> 8;
+      packet.header[7] = data_offset;
+      packet.header[8] = data_length >> 8;
+      packet.header[9] = data_length;
+      packet.destination = destination.endpoint();
+      packet.socket = &socket;
+      packet.pixel_offset = (segment.first_led + led) * 3;
+      packet.size = data_length;
+      packets_.push_back(packet);
+    }
+    led_end = std::max(led_end, segment.first_led + segment.led_count);
+  }
+  pixels_.resize(led_end * 3, 0);
+
+  // Keep the datagrams of each socket together, such that they can be passed to sendmmsg in one batch.
+  std::stable_sort(packets_.begin(), packets_.end(),
+                   [](const Packet& a, const Packet& b) { return a.socket < b.socket; });
+
+#ifdef __linux__
+  // The headers and payloads are gathered from where they are, the pixel buffer is never copied.
+  iovecs_.resize(packets_.size() * 2);
+  headers_.resize(packets_.size());
+  for (size_t i = 0; i < packets_.size(); i++)
+  {
+    Packet& packet = packets_[i];
+    iovecs_[i * 2] = { packet.header.data(), packet.header.size() };
+    iovecs_[i * 2 + 1] = { pixels_.data() + packet.pixel_offset, packet.size };
+    headers_[i] = mmsghdr{};
+    headers_[i].msg_hdr.msg_name = packet.destination.data();
+    headers_[i].msg_hdr.msg_namelen = packet.destination.size();
+    headers_[i].msg_hdr.msg_iov = &iovecs_[i * 2];
+    headers_[i].msg_hdr.msg_iovlen = 2;
+  }
+#endif
+}
+
+bool UdpOutput::decode(const Message& msg)
+{
+  if (msg.type == COLOR)
+  {
+    for (size_t i = 0; i < ColorData::leds_per_message; i++)
+    {
+      const size_t index = (msg.color.offset + i) * 3;
+      if (index < pixels_.size())
+      {
+        pixels_[index + 0] = msg.color.color[i].R;
+        pixels_[index + 1] = msg.color.color[i].G;
+        pixels_[index + 2] = msg.color.color[i].B;
+      }
+    }
+    return msg.color.settings & ColorData::settings_show_after;
+  }
+  if (msg.type == COLOR_RGB565)
+  {
+    for (size_t i = 0; i < ColorData565::leds_per_message; i++)
+    {
+      const size_t index = (msg.color565.offset + i) * 3;
+      if (index < pixels_.size())
+      {
+        const RGB color = ColorData565::decode(msg.color565.color[i]);
+        pixels_[index + 0] = color.R;
+        pixels_[index + 1] = color.G;
+        pixels_[index + 2] = color.B;
+      }
+    }
+    return msg.color565.settings & ColorData::settings_show_after;
+  }
+  return false;
+}
+
+void UdpOutput::asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler)
+{
+  // Sending datagrams doesn't block for any meaningful time, this happens on the io thread.
+  boost::system::error_code error;
+  size_t written = 0;
+  for (const auto& buffer : buffers)
+  {
+    const Message* messages = static_cast<const Message*>(buffer.data());
+    for (size_t i = 0; i < buffer.size() / sizeof(Message); i++)
+    {
+      if (decode(messages[i]))
+      {
+        error = send();
+      }
+    }
+    written += buffer.size();
+  }
+  io_.post([handler, error, written]() { handler(error, written); });
+}
+
+void UdpOutput::asyncRead(boost::asio::mutable_buffer, Handler)
+{
+  // Controllers don't send anything back.
+}
+
+boost::system::error_code UdpOutput::send()
+{
+  // DDP sequence numbers run from 1 to 15, 0 means the sequence is not used.
+  sequence_ = (sequence_ % 15) + 1;
+  for (auto& packet : packets_)
+  {
+    packet.header[1] = sequence_;
+  }
+
+  boost::system::error_code error;
+  size_t bytes = 0;
+  size_t send_calls = 0;
+  size_t send_errors = 0;
+#ifdef __linux__
+  const size_t batch = (batch_ == 0) ? packets_.size() : batch_;
+  size_t sent = 0;
+  while (sent < headers_.size())
+  {
+    auto& socket = *packets_[sent].socket;
+    size_t count = 1;
+    while ((count < batch) && (sent + count < headers_.size()) && (packets_[sent + count].socket == &socket))
+    {
+      count++;
+    }
+    const int res = sendmmsg(socket.native_handle(), &headers_[sent], count, 0);
+    send_calls++;
+    if (res < 0)
+    {
+      // Skip the datagram that failed, the others may still arrive.
+      error = boost::system::error_code(errno, boost::system::system_category());
+      send_errors++;
+      sent++;
+      continue;
+    }
+    for (int i = 0; i < res; i++)
+    {
+      bytes += headers_[sent + i].msg_len;
+    }
+    sent += res;
+  }
+#else
+  for (const auto& packet : packets_)
+  {
+    const std::array<boost::asio::const_buffer, 2> buffers{
+      boost::asio::buffer(packet.header), boost::asio::buffer(pixels_.data() + packet.pixel_offset, packet.size)
+    };
+    boost::system::error_code send_error;
+    bytes += packet.socket->send_to(buffers, packet.destination, 0, send_error);
+    send_calls++;
+    if (send_error)
+    {
+      error = send_error;
+      send_errors++;
+    }
+  }
+#endif
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  statistics_.frames++;
+  statistics_.packets += packets_.size() - send_errors;
+  statistics_.bytes += bytes;
+  statistics_.send_calls += send_calls;
+  statistics_.send_errors += send_errors;
+  return error;
+}
+
+boost::asio::ip::udp::socket& UdpOutput::socketFor(const boost::asio::ip::udp& protocol)
+{
+  auto& socket = (protocol == boost::asio::ip::udp::v6()) ? socket_v6_ : socket_v4_;
+  if (!socket.is_open())
+  {
+    socket.open(protocol);
+  }
+  return socket;
+}
+
+UdpOutput::Statistics UdpOutput::getStatistics() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
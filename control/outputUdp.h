@@ -0,0 +1,135 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef OUTPUT_UDP_H
+#define OUTPUT_UDP_H
+
+#include <array>
+#include <mutex>
+#include "../firmware/messages.h"
+#include "output.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+/**
+ * @brief Output to networked led controllers using the Distributed Display Protocol (DDP). The color messages written
+ *        by Lights are decoded into a pixel buffer, when a message requests the leds to be shown the pixels of each
+ *        segment are sent to their controller. Each segment is sent in as few datagrams as possible, all datagrams of
+ *        a frame are handed to the kernel in batches through sendmmsg.
+ *
+ * Packets consist of the ten byte DDP header followed by the RGB data. The last packet of each segment has the push
+ * flag set, which tells the controller to show the data it received.
+ */
+class UdpOutput : public Output
+{
+public:
+  /**
+   * @brief A range of leds that is sent to a controller.
+   */
+  struct Segment
+  {
+    std::string address;            //!< Address of the controller.
+    uint16_t port{ 4048 };          //!< Port of the controller, 4048 is the DDP port.
+    size_t first_led{ 0 };          //!< First led of the canvas that is sent to this controller.
+    size_t led_count{ 0 };          //!< Number of leds sent to this controller.
+    size_t controller_offset{ 0 };  //!< Index of the controller's pixel that the first led is written to.
+  };
+
+  /**
+   * @brief Statistics about the datagrams sent.
+   */
+  struct Statistics
+  {
+    size_t frames{ 0 };       //!< Number of frames sent.
+    size_t packets{ 0 };      //!< Number of datagrams sent.
+    size_t bytes{ 0 };        //!< Number of bytes sent, including the DDP headers.
+    size_t send_calls{ 0 };   //!< Number of system calls used to send the datagrams.
+    size_t send_errors{ 0 };  //!< Number of system calls that failed.
+  };
+
+  static constexpr const size_t header_size{ 10 };           //!< Size of the DDP header.
+  static constexpr const size_t max_leds_per_packet{ 480 };  //!< Leds in a datagram of 1440 data bytes.
+
+  /**
+   * @brief Create the output.
+   * @param io The io service on which the handlers are called.
+   * @param segments The segments of leds and the controllers they are sent to.
+   * @param led_count The number of leds in the frames written by Lights, segments must lie within them.
+   * @param batch The number of datagrams passed to a single sendmmsg call, 0 passes all datagrams of a frame at once.
+   * @param leds_per_packet The maximum number of leds in a single datagram.
+   */
+  UdpOutput(boost::asio::io_service& io, const std::vector<Segment>& segments, size_t led_count, size_t batch = 0,
+            size_t leds_per_packet = max_leds_per_packet);
+
+  void asyncWrite(const std::vector<boost::asio::const_buffer>& buffers, Handler handler) override;
+  void asyncRead(boost::asio::mutable_buffer buffer, Handler handler) override;
+
+  /**
+   * @brief Return the statistics about the datagrams sent.
+   */
+  Statistics getStatistics() const;
+
+private:
+  /**
+   * @brief A datagram, its header and the range of the pixel buffer that is its payload.
+   */
+  struct Packet
+  {
+    std::array<uint8_t, header_size> header;     //!< The DDP header, the sequence is updated for each frame.
+    boost::asio::ip::udp::endpoint destination;  //!< The controller to send to.
+    boost::asio::ip::udp::socket* socket;        //!< The socket of the destination's address family.
+    size_t pixel_offset;                         //!< Byte offset of the payload in the pixel buffer.
+    size_t size;                                 //!< Size of the payload in bytes.
+  };
+
+  /**
+   * @brief Decode a color message into the pixel buffer.
+   * @return True if the message requests the leds to be shown.
+   */
+  bool decode(const Message& msg);
+
+  /**
+   * @brief Send the current pixels to all controllers.
+   */
+  boost::system::error_code send();
+
+  /**
+   * @brief Return the socket for the protocol of a destination, opening it if this is the first use.
+   */
+  boost::asio::ip::udp::socket& socketFor(const boost::asio::ip::udp& protocol);
+
+  boost::asio::io_service& io_;          //!< The io service on which the handlers are called.
+  boost::asio::ip::udp::socket socket_v4_;  //!< The socket that sends the datagrams to IPv4 controllers.
+  boost::asio::ip::udp::socket socket_v6_;  //!< The socket that sends the datagrams to IPv6 controllers.
+  size_t batch_;                         //!< Number of datagrams per sendmmsg call.
+  std::vector<uint8_t> pixels_;          //!< The RGB data of all leds, indexed by led.
+  std::vector<Packet> packets_;          //!< The datagrams that make up a frame.
+  uint8_t sequence_{ 0 };                //!< Sequence number of the last frame, 1 to 15.
+#ifdef __linux__
+  std::vector<iovec> iovecs_;     //!< The header and payload of each packet.
+  std::vector<mmsghdr> headers_;  //!< The message of each packet, passed to sendmmsg.
+#endif
+
+  mutable std::mutex mutex_;  //!< Guards the statistics.
+  Statistics statistics_;     //!< The statistics.
+};
+
+#endif
@@ -0,0 +1,449 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "pipeline.h"
+#include <algorithm>
+#include <iostream>
+
+ConfigChanges compareConfigs(const DisplayLightConfig& a, const DisplayLightConfig& b)
+{
+  ConfigChanges changes;
+  changes.capture = (a.configs.size() != b.configs.size()) || (a.strips.size() != b.strips.size()) ||
+                    (a.cell_depth_horizontal != b.cell_depth_horizontal) ||
+                    (a.cell_depth_vertical != b.cell_depth_vertical) || (a.edge_capture != b.edge_capture);
+  for (size_t i = 0; !changes.capture && (i < a.configs.size()); i++)
+  {
+    changes.capture = (std::string(a.configs[i]) != std::string(b.configs[i]));
+  }
+  for (size_t i = 0; !changes.capture && (i < a.strips.size()); i++)
+  {
+    changes.capture = (std::string(a.strips[i]) != std::string(b.strips[i]));
+  }
+  changes.density = (a.sample_budget_us != b.sample_budget_us);
+  changes.box_change = (a.box_change_probes != b.box_change_probes) || (a.box_refresh_frames != b.box_refresh_frames);
+  // The damage tracking and the box changes also decide whether strips are sampled in a single pass.
+  changes.samples = changes.density || changes.box_change || (a.sample_distance != b.sample_distance) ||
+                    (a.sample_jitter != b.sample_jitter) || (a.damage_tracking != b.damage_tracking);
+  changes.rate = (a.frame_rate != b.frame_rate) || (a.frame_rate_min != b.frame_rate_min) ||
+                 (a.frame_rate_max != b.frame_rate_max) || (a.motion_low != b.motion_low) ||
+                 (a.motion_high != b.motion_high) || (a.motion_hold_ms != b.motion_hold_ms);
+  return changes;
+}
+
+size_t samplesPerBox(size_t level)
+{
+  return size_t{ 8 } << level;
+}
+
+StripPipeline::StripPipeline(std::vector<Strip> strips, bool multiple, const DisplayLightConfig& config,
+                             Metrics& metrics)
+  : strips_(std::move(strips))
+  , multiple_(multiple)
+  , config_(config)
+  , metrics_(metrics)
+  , density_{ { config.sample_budget_us }, 3 }
+{
+  for (auto& strip : strips_)
+  {
+    strip.analyzer.setCellDepth(config_.cell_depth_horizontal, config_.cell_depth_vertical);
+    strip.changes = BoxChangeDetector(config_.box_change_probes, config_.box_refresh_frames);
+  }
+}
+
+std::vector<Strip>& StripPipeline::strips()
+{
+  return strips_;
+}
+
+void StripPipeline::applyConfig(const ConfigChanges& changes)
+{
+  // The adapted density is kept, unless its budget changed.
+  if (changes.density)
+  {
+    density_ = DensityController{ { config_.sample_budget_us }, density_.level() };
+  }
+  for (size_t i = 0; i < strips_.size(); i++)
+  {
+    auto& strip = strips_[i];
+    if (changes.capture)
+    {
+      strip.analyzer.setCellDepth(config_.cell_depth_horizontal, config_.cell_depth_vertical);
+    }
+    if (changes.box_change)
+    {
+      strip.changes = BoxChangeDetector(config_.box_change_probes, config_.box_refresh_frames);
+    }
+    if (changes.samples)
+    {
+      strip.sample_bounds = Box{};  // Makes the sample points again.
+    }
+    if (multiple_ && changes.capture)
+    {
+      const auto& strip_config = config_.strips[i];
+      strip.desktop = Box(strip_config.x_offset, strip_config.x_offset + strip_config.width, strip_config.y_offset,
+                          strip_config.y_offset + strip_config.height);
+    }
+  }
+}
+
+void StripPipeline::resetSamples()
+{
+  for (auto& strip : strips_)
+  {
+    strip.sample_bounds = Box{};
+  }
+}
+
+void StripPipeline::process(Image::Ptr& image, PixelSniffer& sniff, const std::vector<Box>* damage)
+{
+  stage_.start();
+  makeViews(image);
+  const bool bounds_changed = findBorders();
+  if (bounds_changed && config_.edge_capture)
+  {
+    captureEdges(image, sniff);
+  }
+  metrics_.bounds_changes += bounds_changed;
+
+  // Multiple strips are sampled in a single pass over the frame, pixels they have in common are read once.
+  if (combined() && (bounds_changed || density_changed_))
+  {
+    density_changed_ = false;
+    std::vector<SamplePlan::Layout> layouts;
+    plan_canvases_.clear();
+    for (auto& strip : strips_)
+    {
+      if (strip.visible())
+      {
+        const Box& b = strip.bounds;
+        const Box& a = strip.area;
+        layouts.push_back({ Box(b.x_min + a.x_min, b.x_max + a.x_min, b.y_min + a.y_min, b.y_max + a.y_min),
+                            &strip.sample_points });
+        plan_canvases_.push_back(&strip.canvas);
+      }
+    }
+    plan_ = SamplePlan(layouts);
+    metrics_.plan_rebuilds++;
+  }
+  metrics_.add(Metrics::STAGE_BORDERS, stage_.stop());
+
+  stage_.start();
+  const size_t boxes_sampled = sample(*image, damage);
+  const double sample_us = stage_.stop();
+  metrics_.add(Metrics::STAGE_SAMPLE, sample_us);
+  adaptDensity(sample_us);
+  metrics_.boxes_sampled += boxes_sampled;
+  metrics_.boxes_sampled_last = boxes_sampled;
+
+  stage_.start();
+  write();
+  metrics_.add(Metrics::STAGE_OUTPUT, stage_.stop());
+}
+
+void StripPipeline::repeat()
+{
+  size_t offset = 0;
+  for (auto& strip : strips_)
+  {
+    auto view = strip.lights->canvas();
+    if (!strip.visible() || (offset + view.size() > colors_.size()))
+    {
+      continue;  // Nothing was processed for this strip yet.
+    }
+    for (size_t i = 0; i < view.size(); i++)
+    {
+      view[i] = colors_[offset + i];
+    }
+    offset += view.size();
+    strip.lights->write();
+  }
+}
+
+const std::vector<RGB>& StripPipeline::colors() const
+{
+  return colors_;
+}
+
+bool StripPipeline::combined() const
+{
+  return multiple_ && !config_.damage_tracking && !config_.box_change_probes && (config_.sample_jitter <= 1);
+}
+
+void StripPipeline::makeViews(const Image::Ptr& image)
+{
+  const Box whole(0, image->getWidth(), 0, image->getHeight());
+  for (auto& strip : strips_)
+  {
+    strip.area = multiple_ ? strip.capture.intersection(whole) : whole;
+    strip.image = (strip.area == whole) ? image : std::make_shared<ImageView>(image, strip.area);
+  }
+}
+
+bool StripPipeline::findBorders()
+{
+  bool bounds_changed = false;
+  for (auto& strip : strips_)
+  {
+    if (!strip.visible())
+    {
+      continue;
+    }
+    strip.bounds = strip.analyzer.findBorders(*strip.image);
+    strip.moved = !(strip.bounds == strip.sample_bounds);
+    if (strip.moved)
+    {
+      makeSamples(strip);
+      bounds_changed = true;
+      metrics_.plan_rebuilds++;
+    }
+  }
+  return bounds_changed;
+}
+
+void StripPipeline::makeSamples(Strip& strip)
+{
+  if (config_.sample_budget_us)
+  {
+    strip.sample_levels.clear();
+    for (size_t level = 0; level < DensityController::Settings{}.levels; level++)
+    {
+      strip.sample_levels.push_back(strip.analyzer.makeBoxSamplesByCount(samplesPerBox(level), strip.bounds));
+    }
+    strip.sample_points = strip.sample_levels[density_.level()];
+  }
+  else
+  {
+    strip.sample_points = strip.analyzer.makeBoxSamples(config_.sample_distance, strip.bounds);
+  }
+  strip.sample_bounds = strip.bounds;
+  strip.changes.reset();
+  if (config_.sample_jitter > 1)
+  {
+    strip.sample_variants =
+        strip.analyzer.makeBoxSampleVariants(config_.sample_distance, strip.bounds, config_.sample_jitter);
+    // Any steps consecutive variants cover every column of offsets, averaging over all of them would make a scene cut
+    // take steps * steps frames to settle.
+    strip.filter = TemporalFilter(std::min(config_.sample_jitter, config_.sample_distance));
+  }
+}
+
+void StripPipeline::captureEdges(Image::Ptr& image, PixelSniffer& sniff)
+{
+  std::vector<Box> regions;
+  for (const auto& strip : strips_)
+  {
+    if (!strip.visible())
+    {
+      continue;
+    }
+    const Box& area = strip.area;
+    for (const auto& r : strip.analyzer.captureRegions(area.width(), area.height(), strip.bounds))
+    {
+      regions.emplace_back(r.x_min + area.x_min, r.x_max + area.x_min, r.y_min + area.y_min, r.y_max + area.y_min);
+    }
+  }
+  // The cells moved, grab them again for this frame.
+  if (sniff.prepareRegions(regions) && sniff.grabContent())
+  {
+    image = sniff.getScreen();
+    makeViews(image);
+  }
+}
+
+size_t StripPipeline::sample(const Image& image, const std::vector<Box>* damage)
+{
+  if (combined())
+  {
+    plan_.sample(image, plan_canvases_);
+  }
+  size_t boxes_sampled = 0;
+  colors_.clear();
+  for (auto& strip : strips_)
+  {
+    if (!strip.visible())
+    {
+      continue;
+    }
+    if (combined())
+    {
+      boxes_sampled += strip.sample_points.size();
+      colors_.insert(colors_.end(), strip.canvas.begin(), strip.canvas.end());
+    }
+    else
+    {
+      boxes_sampled += sampleStrip(strip, damage);
+    }
+  }
+  return boxes_sampled;
+}
+
+size_t StripPipeline::sampleStrip(Strip& strip, const std::vector<Box>* damage)
+{
+  size_t boxes_sampled = strip.sample_points.size();
+  if (config_.damage_tracking)
+  {
+    // Only sample the boxes that changed, all of them if the damage is unknown or the boxes moved.
+    strip_damage_.clear();
+    if (!damage || strip.moved)
+    {
+      strip_damage_.emplace_back(0, strip.area.width(), 0, strip.area.height());
+    }
+    else
+    {
+      for (const auto& box : *damage)
+      {
+        const Box local = box.intersection(strip.area);
+        if (local.width() && local.height())
+        {
+          strip_damage_.emplace_back(local.x_min - strip.area.x_min, local.x_max - strip.area.x_min,
+                                     local.y_min - strip.area.y_min, local.y_max - strip.area.y_min);
+        }
+      }
+    }
+    // Not known which boxes were skipped, all of them are counted.
+    strip.analyzer.sample(*strip.image, strip.bounds, strip.sample_points, strip.canvas, strip_damage_);
+  }
+  else if (config_.box_change_probes)
+  {
+    // Only sample the boxes of which the probes changed, or that are due for a refresh.
+    const auto& changed = strip.changes.update(*strip.image, strip.bounds, strip.sample_points);
+    strip.analyzer.sample(*strip.image, strip.bounds, strip.sample_points, strip.canvas, changed);
+    boxes_sampled = changed.size();
+  }
+  else if (config_.sample_jitter > 1)
+  {
+    // Sample with the next shifted grid, averaging over the variants makes every point of the dense grid count.
+    const auto& points = strip.sample_variants[strip.variant];
+    strip.variant = (strip.variant + 1) % strip.sample_variants.size();
+    strip.analyzer.sample(*strip.image, strip.bounds, points, strip.canvas);
+    strip.filter.apply(strip.canvas);
+    boxes_sampled = points.size();
+  }
+  else
+  {
+    // Sample directly into the frame that is to be sent to the lights.
+    auto view = strip.lights->canvas();
+    strip.analyzer.sample(*strip.image, strip.bounds, strip.sample_points, view);
+    for (size_t i = 0; i < view.size(); i++)
+    {
+      colors_.push_back(view[i]);
+    }
+    return boxes_sampled;
+  }
+  colors_.insert(colors_.end(), strip.canvas.begin(), strip.canvas.end());
+  return boxes_sampled;
+}
+
+void StripPipeline::adaptDensity(double sample_us)
+{
+  if (config_.sample_budget_us && density_.update(sample_us))
+  {
+    for (auto& strip : strips_)
+    {
+      if (!strip.sample_levels.empty())
+      {
+        strip.sample_points = strip.sample_levels[density_.level()];
+        strip.changes.reset();
+      }
+    }
+    density_changed_ = true;
+    metrics_.plan_rebuilds++;
+  }
+  metrics_.samples_per_box = config_.sample_budget_us ? samplesPerBox(density_.level()) : 0;
+}
+
+void StripPipeline::write()
+{
+  // A single strip sampled without state of its own was sampled into the lights directly.
+  const bool canvas = multiple_ || config_.damage_tracking || config_.box_change_probes || (config_.sample_jitter > 1);
+  for (auto& strip : strips_)
+  {
+    if (!strip.visible())
+    {
+      continue;
+    }
+    if (canvas)
+    {
+      strip.lights->write(strip.canvas);
+    }
+    else
+    {
+      strip.lights->write();
+    }
+  }
+}
+
+PreviewWriter::PreviewWriter(const std::string& path) : path_(path)
+{
+}
+
+void PreviewWriter::write(const Image& image, std::vector<Strip>& strips, const std::vector<RGB>& colors, double hz)
+{
+  const size_t width = image.getWidth();
+  const size_t height = image.getHeight();
+  if (!video_ || (video_->width() != width) || (video_->height() != height))
+  {
+    // The rate is stated in millihertz, such that fractional rates and rates below 1 hz are written correctly.
+    const uint32_t millihertz = std::max<uint32_t>(1, static_cast<uint32_t>(hz * 1000 + 0.5));
+    video_ = std::make_unique<Y4MWriter>(segmentPath(path_, video_ ? ++segment_ : 0), width, height, millihertz, 1000);
+  }
+  if (!frame_)
+  {
+    frame_ = std::make_shared<Image>(Image::Bitmap(height, std::vector<uint32_t>(width, 0)));
+  }
+
+  // Colorize the boxes of each strip in place, on its area of the frame.
+  frame_->assign(image);
+  size_t offset = 0;
+  for (auto& strip : strips)
+  {
+    if (strip.visible())
+    {
+      canvas_.assign(colors.begin() + offset, colors.begin() + offset + strip.canvas.size());
+      offset += strip.canvas.size();
+      strip.analyzer.boxColorizer(canvas_, *frame_, strip.area);
+    }
+  }
+  if (!video_->write(*frame_))
+  {
+    std::cerr << "Failed to write a " << width << " x " << height << " frame to the preview." << std::endl;
+  }
+}
+
+void PreviewWriter::repeat()
+{
+  if (video_)
+  {
+    video_->write(*frame_);  // The same frame with the same colors.
+  }
+}
+
+std::string PreviewWriter::segmentPath(const std::string& path, size_t segment)
+{
+  if (segment == 0)
+  {
+    return path;
+  }
+  size_t split = path.rfind('.');
+  if ((split == std::string::npos) || (path.find('/', split) != std::string::npos))
+  {
+    split = path.size();  // No extension.
+  }
+  return path.substr(0, split) + "." + std::to_string(segment) + path.substr(split);
+}
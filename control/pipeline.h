@@ -0,0 +1,243 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "analyzer.h"
+#include "config.h"
+#include "image.h"
+#include "lights.h"
+#include "metrics.h"
+#include "pixelsniff.h"
+#include "timing.h"
+#include "y4m.h"
+
+/**
+ * @brief A led strip and the analysis of the area of the captured image it represents.
+ */
+struct Strip
+{
+  std::string name;                                      //!< The output of the strip.
+  std::unique_ptr<Lights> lights;                        //!< Lights driving the strip.
+  Box desktop;                                           //!< Area of the desktop, empty to use the entire capture area.
+  Box capture;                                           //!< Area of the desktop in coordinates of the capture area.
+  Analyzer analyzer;                                     //!< Analysis of the area.
+  Box sample_bounds;                                     //!< The bounds the sample points were made for.
+  std::vector<BoxSamples> sample_points;                 //!< Sample points for the sample bounds.
+  std::vector<RGB> canvas{ Lights::makeCanvas() };       //!< Colors of the boxes, retained when tracking damage.
+  Box area;                                              //!< Area of the current frame the strip represents.
+  Image::Ptr image;                                      //!< View on that area of the current frame.
+  Box bounds;                                            //!< Bounds found in the current frame.
+  bool moved{ false };                                   //!< True if the bounds differ from the sample bounds.
+  BoxChangeDetector changes;                             //!< Finds the boxes that changed, if enabled.
+  std::vector<std::vector<BoxSamples>> sample_variants;  //!< Shifted sample points, one is used each frame.
+  size_t variant{ 0 };                                   //!< The variant that is used next.
+  TemporalFilter filter;                                 //!< Averages the colors sampled with the variants.
+  std::vector<std::vector<BoxSamples>> sample_levels;    //!< Sample points for each level of the density controller.
+
+  /**
+   * @brief Return true if the strip represents part of the current frame.
+   */
+  bool visible() const
+  {
+    return area.width() && area.height();
+  }
+};
+
+/**
+ * @brief The parts of the processing that are built from the config, a reload only rebuilds those whose keys changed.
+ */
+struct ConfigChanges
+{
+  bool capture{ false };     //!< The capture area, from the region configs, the strips, the cell depth or edge capture.
+  bool samples{ false };     //!< The sample points and the way they are sampled.
+  bool rate{ false };        //!< The rate controller.
+  bool density{ false };     //!< The density controller.
+  bool box_change{ false };  //!< The detectors of the boxes that changed.
+};
+
+/**
+ * @brief Determine which parts of the processing have to be rebuilt to go from one config to the other.
+ */
+ConfigChanges compareConfigs(const DisplayLightConfig& a, const DisplayLightConfig& b);
+
+/**
+ * @brief Return the number of sample points in each box at a level of the density controller, doubling each level.
+ */
+size_t samplesPerBox(size_t level);
+
+/**
+ * @brief Turns the captured frames into the colors of the strips. In each frame the borders are found in the area of
+ *        each strip, its boxes are sampled in the way the config selects and the colors are written to its lights. The
+ *        config is read while processing, changes that require rebuilding something are passed to applyConfig().
+ */
+class StripPipeline
+{
+public:
+  /**
+   * @brief Create the pipeline.
+   * @param strips The strips, their lights connected.
+   * @param multiple True if each strip represents its own area of the capture area, false for a single strip that
+   *        represents all of it.
+   * @param config The config, it has to outlive the pipeline.
+   * @param metrics The metrics the stages of the processing are reported to.
+   */
+  StripPipeline(std::vector<Strip> strips, bool multiple, const DisplayLightConfig& config, Metrics& metrics);
+
+  /**
+   * @brief Return the strips.
+   */
+  std::vector<Strip>& strips();
+
+  /**
+   * @brief Rebuild the parts of the processing of which the keys changed, after the config was reloaded.
+   */
+  void applyConfig(const ConfigChanges& changes);
+
+  /**
+   * @brief Make the sample points again in the next frame.
+   */
+  void resetSamples();
+
+  /**
+   * @brief Process a captured frame and write the colors to the lights.
+   * @param image The captured frame, replaced if edge capture grabs the moved regions again.
+   * @param sniff The sniffer that captured the frame.
+   * @param damage The areas of the frame that changed since the previous one, nullptr if that is not known.
+   */
+  void process(Image::Ptr& image, PixelSniffer& sniff, const std::vector<Box>* damage);
+
+  /**
+   * @brief Write the colors of the last processed frame again. Lights only sends what differs from the leds, but
+   *        refreshes them in full often enough to keep the firmware's decay from dimming them.
+   */
+  void repeat();
+
+  /**
+   * @brief Return the colors of all strips in the last processed frame.
+   */
+  const std::vector<RGB>& colors() const;
+
+private:
+  std::vector<Strip> strips_;                     //!< The strips.
+  bool multiple_;                                 //!< True if each strip represents its own area.
+  const DisplayLightConfig& config_;              //!< The config.
+  Metrics& metrics_;                              //!< The metrics the stages are reported to.
+  DensityController density_;                     //!< Adapts the sample points to the time sampling may take.
+  bool density_changed_{ false };                 //!< The sample points changed without the bounds moving.
+  SamplePlan plan_;                               //!< Samples all strips in a single pass, if they are combined.
+  std::vector<std::vector<RGB>*> plan_canvases_;  //!< The canvases the plan samples into.
+  std::vector<Box> strip_damage_;                 //!< The damage in the area of the strip being sampled.
+  std::vector<RGB> colors_;                       //!< Colors of all strips.
+  Measure stage_;                                 //!< Timing of the stage being processed.
+
+  /**
+   * @brief Return true if the strips are sampled in a single pass over the frame, the sampling modes that keep
+   *        state for each strip sample them separately.
+   */
+  bool combined() const;
+
+  /**
+   * @brief Set each strip's view on the area of the captured image it represents.
+   */
+  void makeViews(const Image::Ptr& image);
+
+  /**
+   * @brief Find the borders in the area of each strip, the sample points are made again if they moved.
+   * @return True if the bounds of a strip moved.
+   */
+  bool findBorders();
+
+  /**
+   * @brief Make the sample points of a strip for its bounds.
+   */
+  void makeSamples(Strip& strip);
+
+  /**
+   * @brief Capture just the regions the analysis reads from now on, the frame is grabbed again with them.
+   */
+  void captureEdges(Image::Ptr& image, PixelSniffer& sniff);
+
+  /**
+   * @brief Sample the boxes of all strips, collecting the colors.
+   * @return The number of boxes sampled.
+   */
+  size_t sample(const Image& image, const std::vector<Box>* damage);
+
+  /**
+   * @brief Sample the boxes of a strip that isn't sampled by the plan in the way the config selects, collecting its
+   *        colors.
+   * @return The number of boxes sampled.
+   */
+  size_t sampleStrip(Strip& strip, const std::vector<Box>* damage);
+
+  /**
+   * @brief Keep sampling within its budget, the boxes get more or fewer points from the next frame on.
+   */
+  void adaptDensity(double sample_us);
+
+  /**
+   * @brief Write the colors of each strip to its lights.
+   */
+  void write();
+};
+
+/**
+ * @brief Writes the captured frames with the colors of the strips' boxes drawn on them to a .y4m video. A video has a
+ *        single size, when the size of the frames changes a new segment is started in a file numbered after the path.
+ */
+class PreviewWriter
+{
+public:
+  /**
+   * @brief Create the writer, the first frame creates the video.
+   */
+  PreviewWriter(const std::string& path);
+
+  /**
+   * @brief Draw the colors on the frame and append it to the video.
+   * @param hz The rate stated in the header if a segment is started. The rate adapts while running, so this is the
+   *        nominal rate.
+   */
+  void write(const Image& image, std::vector<Strip>& strips, const std::vector<RGB>& colors, double hz);
+
+  /**
+   * @brief Append the last frame again.
+   */
+  void repeat();
+
+  /**
+   * @brief Return the path of a segment, the first segment is the path itself and the next ones are numbered before
+   *        the extension.
+   */
+  static std::string segmentPath(const std::string& path, size_t segment);
+
+private:
+  std::string path_;                  //!< Path of the first segment.
+  size_t segment_{ 0 };               //!< The segment being written.
+  std::unique_ptr<Y4MWriter> video_;  //!< The segment being written.
+  Image::Ptr frame_;                  //!< The last frame, with the colors drawn on it.
+  std::vector<RGB> canvas_;           //!< Colors of the strip being drawn.
+};
+
+#endif
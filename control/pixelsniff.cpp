@@ -54,6 +54,22 @@ Image::Ptr PixelSniffer::getScreen()
 }
 
 
+bool PixelSniffer::prepareRegions(const std::vector<Box>&)
+{
+  return false;
+}
+
+bool PixelSniffer::setDamageTracking(bool)
+{
+  return false;
+}
+
+bool PixelSniffer::getDamage(std::vector<Box>& damage)
+{
+  damage.clear();
+  return false;
+}
+
 PixelSniffer::Resolution PixelSniffer::getFullResolution()
 {
   return Resolution(0, 0);
@@ -27,6 +27,7 @@
 #include <string>
 #include <vector>
 
+#include "box.h"
 #include "image.h"
 
 class PixelSniffer
@@ -68,10 +69,49 @@ public:
   virtual bool prepareCapture(size_t x = 0, size_t y = 0, size_t width = 0, size_t height = 0);
 
 
+  /**
+   * @brief Only capture these regions of the capture area, the screen still has the dimensions of the capture area but
+   *        pixels outside of the regions are unspecified. Calling prepareCapture() captures the entire area again.
+   * @param regions The regions to capture, in coordinates of the capture area. Empty to capture the entire area.
+   * @return False if capturing regions is not supported, the entire area is captured.
+   */
+  virtual bool prepareRegions(const std::vector<Box>& regions);
+
+  /**
+   * @brief Enable or disable tracking which regions of the capture area change, this is disabled initially.
+   * @return False if changes can't be tracked.
+   */
+  virtual bool setDamageTracking(bool enabled);
+
+  /**
+   * @brief Retrieve the regions of the capture area that changed since the previous call.
+   * @param damage Is populated with the changed regions, in coordinates of the capture area.
+   * @return False if changes can't be tracked, the content should be considered changed entirely.
+   */
+  virtual bool getDamage(std::vector<Box>& damage);
+
   /**
    * @brief Return the full resolution of the entire desktop. To detect resolution changes.
    */
   virtual Resolution getFullResolution();
 };
 
+/**
+ * @brief Pixel sniffer that plays back frames from a file instead of capturing the screen, playback ends after the
+ *        last frame.
+ */
+class PixelSnifferPlayback : public PixelSniffer
+{
+public:
+  /**
+   * @brief Return true if all frames have been grabbed and the playback doesn't loop.
+   */
+  virtual bool finished() const = 0;
+
+  /**
+   * @brief Return the number of frames that were grabbed.
+   */
+  virtual size_t grabbed() const = 0;
+};
+
 #endif
@@ -0,0 +1,142 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "pixelsniffReplay.h"
+#include <thread>
+
+void PixelSnifferReplay::Frame::set(const Bitmap& frame)
+{
+  // Copy into the existing rows, only reallocate if the dimensions changed.
+  if ((map_.size() != frame.size()) || (!frame.empty() && (map_.front().size() != frame.front().size())))
+  {
+    map_ = frame;
+  }
+  else
+  {
+    for (size_t y = 0; y < frame.size(); y++)
+    {
+      std::copy(frame[y].begin(), frame[y].end(), map_[y].begin());
+    }
+  }
+  height_ = frame.size();
+  width_ = frame.empty() ? 0 : frame.front().size();
+}
+
+PixelSnifferReplay::PixelSnifferReplay(const std::string& filename, bool realtime, bool loop)
+  : recording_(filename), realtime_(realtime), loop_(loop), screen_(std::make_shared<Frame>())
+{
+  if (recording_.size() == 0)
+  {
+    throw std::runtime_error("Recording holds no frames: " + filename);
+  }
+  screen_->set(recording_.read(0));
+}
+
+void PixelSnifferReplay::connect()
+{
+}
+
+bool PixelSnifferReplay::selectRootWindow()
+{
+  return true;
+}
+
+bool PixelSnifferReplay::prepareCapture(size_t, size_t, size_t, size_t)
+{
+  return true;
+}
+
+bool PixelSnifferReplay::grabContent()
+{
+  if (finished_)
+  {
+    return false;
+  }
+
+  size_t index = next_;
+  if (realtime_)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if (grabbed_ == 0)
+    {
+      start_ = now;
+    }
+    uint64_t elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - start_).count() + recording_.timestamp(0);
+    // The last frame is shown for the average frame period.
+    const uint64_t first = recording_.timestamp(0);
+    const uint64_t last = recording_.timestamp(recording_.size() - 1);
+    const uint64_t end = last + ((recording_.size() > 1) ? (last - first) / (recording_.size() - 1) : 0);
+    if ((elapsed > end) && (grabbed_ != 0))
+    {
+      // Past the last frame, the recording ended.
+      if (!loop_)
+      {
+        finished_ = true;
+        return false;
+      }
+      start_ = now;
+      elapsed = recording_.timestamp(0);
+      index = 0;
+    }
+    // Pick the latest frame that was captured at or before this moment in the recording.
+    while ((index + 1 < recording_.size()) && (recording_.timestamp(index + 1) <= elapsed))
+    {
+      index++;
+    }
+    next_ = index;
+  }
+  else
+  {
+    if (index == recording_.size())
+    {
+      if (!loop_)
+      {
+        finished_ = true;
+        return false;
+      }
+      index = 0;
+    }
+    next_ = index + 1;
+  }
+
+  screen_->set(recording_.read(index));
+  grabbed_++;
+  return true;
+}
+
+Image::Ptr PixelSnifferReplay::getScreen()
+{
+  return screen_;
+}
+
+PixelSniffer::Resolution PixelSnifferReplay::getFullResolution()
+{
+  return recording_.getFullResolution();
+}
+
+bool PixelSnifferReplay::finished() const
+{
+  return finished_;
+}
+
+size_t PixelSnifferReplay::grabbed() const
+{
+  return grabbed_;
+}
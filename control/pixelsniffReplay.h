@@ -0,0 +1,74 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef PIXELSNIFFREPLAY_H
+#define PIXELSNIFFREPLAY_H
+
+#include <chrono>
+#include "pixelsniff.h"
+#include "recording.h"
+
+/**
+ * @brief Pixel sniffer that replays a recording instead of capturing the screen, this needs no display at all.
+ *
+ * In real time mode each grab returns the frame that was on the screen at the corresponding moment of the recording,
+ * frames are skipped or repeated as needed. Otherwise each grab returns the next frame, as fast as they are requested.
+ * The recording holds the area that was captured, prepareCapture() doesn't crop it any further.
+ */
+class PixelSnifferReplay : public PixelSnifferPlayback
+{
+public:
+  /**
+   * @brief Open a recording, throws a std::runtime_error if it can't be read.
+   * @param filename The recording to replay.
+   * @param realtime Replay at the speed it was recorded at, otherwise each grab returns the next frame.
+   * @param loop Restart at the first frame after the last one, otherwise grabContent() fails at the end.
+   */
+  PixelSnifferReplay(const std::string& filename, bool realtime = true, bool loop = false);
+
+  void connect();
+  bool selectRootWindow();
+  bool grabContent();
+  Image::Ptr getScreen();
+  bool prepareCapture(size_t x = 0, size_t y = 0, size_t width = 0, size_t height = 0);
+  Resolution getFullResolution();
+  bool finished() const;
+  size_t grabbed() const;
+
+private:
+  /**
+   * @brief Image that is backed by the frame decoded by the recording.
+   */
+  class Frame : public Image
+  {
+  public:
+    void set(const Bitmap& frame);
+  };
+
+  Recording recording_;                          //!< The recording being replayed.
+  bool realtime_;                                //!< Replay at recorded speed.
+  bool loop_;                                    //!< Restart after the last frame.
+  size_t next_{ 0 };                             //!< Next frame to grab if not in real time.
+  size_t grabbed_{ 0 };                          //!< Number of grabs performed.
+  bool finished_{ false };                       //!< True if the end of the recording is reached.
+  std::chrono::steady_clock::time_point start_;  //!< Time at which the first frame is shown in real time mode.
+  std::shared_ptr<Frame> screen_;                //!< The current frame.
+};
+
+#endif
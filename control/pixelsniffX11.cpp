@@ -18,6 +18,8 @@
   SOFTWARE.
 */
 #include "pixelsniffX11.h"
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <fstream>
 #include <sstream>
@@ -116,6 +118,139 @@ static int handleError(Display* display, XErrorEvent* error)
   throw std::runtime_error(error_str);
 }
 
+SharedMemoryPool::SharedMemoryPool(Display* display) : display_(display)
+{
+}
+
+std::shared_ptr<SharedMemoryPool::Segment> SharedMemoryPool::Segment::create(Display* display, size_t size)
+{
+  auto segment = std::make_shared<Segment>();
+  segment->display = display;
+  segment->size = size;
+  segment->info.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+  if (segment->info.shmid == -1)
+  {
+    return nullptr;
+  }
+  segment->info.shmaddr = static_cast<char*>(shmat(segment->info.shmid, 0, 0));
+  if (segment->info.shmaddr == reinterpret_cast<char*>(-1))
+  {
+    shmctl(segment->info.shmid, IPC_RMID, nullptr);
+    return nullptr;
+  }
+  segment->info.readOnly = false;
+
+  // Once the server attached, mark the segment for removal. It then lives until the last process detaches from it.
+  bool attached = false;
+  try
+  {
+    attached = XShmAttach(display, &segment->info);
+    XSync(display, false);
+  }
+  catch (const std::runtime_error& e)
+  {
+    std::cout << "Caught exception in " << __PRETTY_FUNCTION__ << ": " << e.what() << std::endl;
+    attached = false;
+  }
+  shmctl(segment->info.shmid, IPC_RMID, nullptr);
+  if (!attached)
+  {
+    shmdt(segment->info.shmaddr);
+    return nullptr;
+  }
+  return segment;
+}
+
+SharedMemoryPool::Segment::~Segment()
+{
+  try
+  {
+    XShmDetach(display, &info);
+    XSync(display, false);
+  }
+  catch (const std::runtime_error& e)
+  {
+    std::cout << "Caught exception in " << __PRETTY_FUNCTION__ << ": " << e.what() << std::endl;
+  }
+  shmdt(info.shmaddr);
+}
+
+std::shared_ptr<XImage> SharedMemoryPool::acquire(Visual* visual, unsigned int depth, size_t width, size_t height)
+{
+  // Creating the image only fills in its description, this determines the size of the segment it needs.
+  XImage* image = XShmCreateImage(display_, visual, depth, ZPixmap, nullptr, nullptr, width, height);
+  if (image == nullptr)
+  {
+    return nullptr;
+  }
+  const size_t required = image->bytes_per_line * image->height;
+
+  // Use the smallest free segment that is large enough, otherwise replace a free one or add one.
+  std::shared_ptr<Segment> segment;
+  auto replaceable = segments_.end();
+  for (auto it = segments_.begin(); it != segments_.end(); it++)
+  {
+    if ((*it)->in_use)
+    {
+      continue;
+    }
+    if (((*it)->size >= required) && (!segment || ((*it)->size < segment->size)))
+    {
+      segment = *it;
+    }
+    replaceable = it;
+  }
+  if (!segment)
+  {
+    if (replaceable != segments_.end())
+    {
+      segments_.erase(replaceable);
+    }
+    segment = Segment::create(display_, required);
+    if (!segment)
+    {
+      XDestroyImage(image);
+      return nullptr;
+    }
+    segments_.push_back(segment);
+    created_++;
+  }
+
+  // The image refers to the segment's info, the deleter keeps the segment alive for as long as the image exists.
+  image->obdata = reinterpret_cast<char*>(&segment->info);
+  image->data = segment->info.shmaddr;
+  segment->in_use = true;
+  return std::shared_ptr<XImage>(image, [segment](XImage* z) {
+    XDestroyImage(z);  // The shared memory extension's destructor doesn't free the data.
+    segment->in_use = false;
+  });
+}
+
+size_t SharedMemoryPool::size() const
+{
+  return segments_.size();
+}
+
+size_t SharedMemoryPool::inUse() const
+{
+  return std::count_if(segments_.begin(), segments_.end(), [](const auto& segment) { return segment->in_use; });
+}
+
+size_t SharedMemoryPool::bytes() const
+{
+  size_t total = 0;
+  for (const auto& segment : segments_)
+  {
+    total += segment->size;
+  }
+  return total;
+}
+
+size_t SharedMemoryPool::created() const
+{
+  return created_;
+}
+
 PixelSnifferX11::PixelSnifferX11()
 {
   XSetErrorHandler(handleError);  // Register the error handler.
@@ -130,6 +265,55 @@ void PixelSnifferX11::connect()
   {
     throw std::runtime_error("XShmQueryExtension needs to be available.");
   }
+
+#ifdef HAVE_XDAMAGE
+  int error_base = 0;
+  damage_available_ = XDamageQueryExtension(display_, &damage_event_base_, &error_base);
+#endif
+
+  pool_ = std::make_unique<SharedMemoryPool>(display_);
+
+  // Get notified when the root window changes size instead of querying it for each frame.
+  XSelectInput(display_, root_window_, StructureNotifyMask);
+#ifdef HAVE_XRANDR
+  int randr_error_base = 0;
+  randr_available_ = XRRQueryExtension(display_, &randr_event_base_, &randr_error_base);
+  if (randr_available_)
+  {
+    XRRSelectInput(display_, root_window_, RRScreenChangeNotifyMask);
+  }
+#endif
+
+  // Query the resolution once, the events keep it up to date.
+  int x_return, y_return;
+  unsigned int width_return, height_return;
+  unsigned int border_width_return;
+  unsigned int depth_return;
+  Window root_return;
+  XGetGeometry(display_, root_window_, &root_return, &x_return, &y_return, &width_return, &height_return,
+               &border_width_return, &depth_return);
+  resolution_ = Resolution(width_return, height_return);
+}
+
+void PixelSnifferX11::processRootEvents()
+{
+  XEvent event;
+  while (XCheckTypedWindowEvent(display_, root_window_, ConfigureNotify, &event))
+  {
+    resolution_ = Resolution(event.xconfigure.width, event.xconfigure.height);
+  }
+#ifdef HAVE_XRANDR
+  if (randr_available_)
+  {
+    while (XCheckTypedEvent(display_, randr_event_base_ + RRScreenChangeNotify, &event))
+    {
+      // Keeps Xlib's view of the screen in sync, the root window's ConfigureNotify carries the new size.
+      XRRUpdateConfiguration(&event);
+      const auto& change = reinterpret_cast<const XRRScreenChangeNotifyEvent&>(event);
+      resolution_ = Resolution(change.width, change.height);
+    }
+  }
+#endif
 }
 
 std::vector<WindowInfo> PixelSnifferX11::getWindows() const
@@ -139,18 +323,110 @@ std::vector<WindowInfo> PixelSnifferX11::getWindows() const
 
 bool PixelSnifferX11::selectRootWindow()
 {
+  followWindow(window_, false);
   window_ = root_window_;
+  window_name_.clear();
+  window_lost_ = false;
   return prepareCapture();  // default to entire screen.
 }
 
 bool PixelSnifferX11::selectWindow(const WindowInfo& window_info)
 {
+  followWindow(window_, false);
   window_ = window_info.window;
+  window_name_ = window_info.name;
+  window_lost_ = false;
+  followWindow(window_, true);
   return prepareCapture();  // default to entire window.
 }
 
+void PixelSnifferX11::followWindow(Window window, bool follow)
+{
+  if ((window == root_window_) || (window == 0) || window_lost_)
+  {
+    return;  // The root window's events are always selected, a lost window can't be selected on.
+  }
+  XSelectInput(display_, window, follow ? StructureNotifyMask : NoEventMask);
+}
+
+bool PixelSnifferX11::processWindowEvents()
+{
+  if (window_ == root_window_)
+  {
+    return true;
+  }
+  if (window_lost_)
+  {
+    return rematchWindow();
+  }
+
+  // Moves don't matter, the capture is relative to the window. Only a change in size requires a new image.
+  XEvent event;
+  bool resized = false;
+  bool destroyed = false;
+  while (XCheckWindowEvent(display_, window_, StructureNotifyMask, &event))
+  {
+    if (event.type == ConfigureNotify)
+    {
+      resized = (Resolution(event.xconfigure.width, event.xconfigure.height) != window_size_);
+    }
+    destroyed |= (event.type == DestroyNotify);
+  }
+  if (destroyed)
+  {
+    std::cout << "Window \"" << window_name_ << "\" was destroyed." << std::endl;
+    window_lost_ = true;
+#ifdef HAVE_XDAMAGE
+    damage_ = 0;  // The server destroyed the damage object along with the window.
+#endif
+    rematch_time_ = std::chrono::steady_clock::time_point{};
+    return rematchWindow();
+  }
+  if (resized)
+  {
+    return prepareCapture(requested_x_, requested_y_, requested_width_, requested_height_);
+  }
+  return true;
+}
+
+bool PixelSnifferX11::rematchWindow()
+{
+  const auto now = std::chrono::steady_clock::now();
+  if (window_name_.empty() || (now - rematch_time_ < std::chrono::seconds(1)))
+  {
+    return false;
+  }
+  rematch_time_ = now;
+
+  try
+  {
+    for (const auto& window : getWindows())
+    {
+      if ((window.name == window_name_) && (window.width != 0) && (window.height != 0))
+      {
+        std::cout << "Found window \"" << window_name_ << "\" again." << std::endl;
+        window_ = window.window;
+        window_lost_ = false;
+        followWindow(window_, true);
+        return prepareCapture(requested_x_, requested_y_, requested_width_, requested_height_);
+      }
+    }
+  }
+  catch (const std::runtime_error& e)
+  {
+    // Windows may disappear while they are enumerated, try again later.
+    std::cout << "Caught exception in " << __PRETTY_FUNCTION__ << ": " << e.what() << std::endl;
+  }
+  return false;
+}
+
 bool PixelSnifferX11::prepareCapture(size_t x, size_t y, size_t width, size_t height)
 {
+  requested_x_ = x;
+  requested_y_ = y;
+  requested_width_ = width;
+  requested_height_ = height;
+
   // https://tronche.com/gui/x/xlib/window-information/XGetWindowAttributes.html
   // Colormap for a window seems to be different than for the root?
   XWindowAttributes attributes;
@@ -160,6 +436,8 @@ bool PixelSnifferX11::prepareCapture(size_t x, size_t y, size_t width, size_t he
     return false;
   }
 
+  window_size_ = Resolution(attributes.width, attributes.height);
+
   // Handle inputs arguments.
   if (width == 0)
   {
@@ -177,32 +455,154 @@ bool PixelSnifferX11::prepareCapture(size_t x, size_t y, size_t width, size_t he
   y = std::min<size_t>(y, attributes.height);
 
   width = std::min<size_t>(width, attributes.width - x);
-  height = std::min<size_t>(height, attributes.height - x);
-
-  // Create an XImage we'll write to, this will be reused until this function is called again.
-  ximage_ = std::shared_ptr<XImage>(
-      XShmCreateImage(display_, attributes.visual, attributes.depth, ZPixmap, 0, &shminfo_, width, height),
-      [](auto z) { XDestroyImage(z); });
+  height = std::min<size_t>(height, attributes.height - y);
 
-  // Initialise the shared memory information.
-  shminfo_.shmid = shmget(IPC_PRIVATE, ximage_->bytes_per_line * ximage_->height, IPC_CREAT | 0600);
-  ximage_->data = static_cast<char*>(shmat(shminfo_.shmid, 0, 0));
-  shminfo_.shmaddr = ximage_->data;
-  shminfo_.readOnly = false;
-
-  // Attach the shared memory instance.
-  if (!XShmAttach(display_, &shminfo_))
+  // Create an XImage we'll write to, this will be reused until this function is called again. The previous image
+  // returns its segment to the pool.
+  auto image = createSharedImage(width, height);
+  if (!image)
   {
     return false;
   }
+  ximage_ = image;
 
   // Store x and y offsets for later.
   capture_x_ = x;
   capture_y_ = y;
+  regions_.clear();
+
+#ifdef HAVE_XDAMAGE
+  trackDamage();
+#endif
 
   return true;
 }
 
+#ifdef HAVE_XDAMAGE
+void PixelSnifferX11::trackDamage()
+{
+  if (damage_)
+  {
+    XDamageDestroy(display_, damage_);
+    damage_ = 0;
+  }
+  // Track the damage to the window that is captured.
+  if (damage_available_ && damage_tracking_ && window_)
+  {
+    damage_ = XDamageCreate(display_, window_, XDamageReportNonEmpty);
+    damaged_entirely_ = true;
+  }
+}
+#endif
+
+bool PixelSnifferX11::setDamageTracking(bool enabled)
+{
+#ifdef HAVE_XDAMAGE
+  if (enabled != damage_tracking_)
+  {
+    damage_tracking_ = enabled;
+    if (!window_lost_)
+    {
+      trackDamage();
+    }
+  }
+  return damage_available_;
+#else
+  static_cast<void>(enabled);
+  return false;
+#endif
+}
+
+bool PixelSnifferX11::getDamage(std::vector<Box>& damage)
+{
+  damage.clear();
+#ifdef HAVE_XDAMAGE
+  if (!damage_)
+  {
+    return false;
+  }
+
+  // The events only notify that damage occurred, discard them. The damaged area is retrieved below.
+  XEvent event;
+  while (XCheckTypedEvent(display_, damage_event_base_ + XDamageNotify, &event))
+  {
+  }
+
+  // Retrieve the accumulated damage and reset it.
+  XserverRegion region = XFixesCreateRegion(display_, nullptr, 0);
+  XDamageSubtract(display_, damage_, None, region);
+  int count = 0;
+  XRectangle* rectangles = XFixesFetchRegion(display_, region, &count);
+  XFixesDestroyRegion(display_, region);
+
+  const Box capture(capture_x_, capture_x_ + ximage_->width, capture_y_, capture_y_ + ximage_->height);
+  if (damaged_entirely_)
+  {
+    damage.emplace_back(0, capture.width(), 0, capture.height());
+    damaged_entirely_ = false;
+  }
+  for (int i = 0; i < count; i++)
+  {
+    // Convert to coordinates of the capture area, dropping damage outside of it.
+    const XRectangle& r = rectangles[i];
+    const size_t x = std::max<long>(r.x, 0);
+    const size_t y = std::max<long>(r.y, 0);
+    Box rectangle(x, std::max<long>(r.x + r.width, 0), y, std::max<long>(r.y + r.height, 0));
+    if (!rectangle.intersects(capture))
+    {
+      continue;
+    }
+    damage.emplace_back(std::max(rectangle.x_min, capture.x_min) - capture.x_min,
+                        std::min(rectangle.x_max, capture.x_max) - capture.x_min,
+                        std::max(rectangle.y_min, capture.y_min) - capture.y_min,
+                        std::min(rectangle.y_max, capture.y_max) - capture.y_min);
+  }
+  if (rectangles)
+  {
+    XFree(rectangles);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::shared_ptr<XImage> PixelSnifferX11::createSharedImage(size_t width, size_t height)
+{
+  XWindowAttributes attributes;
+  if (!XGetWindowAttributes(display_, window_, &attributes))
+  {
+    return nullptr;
+  }
+  return pool_->acquire(attributes.visual, attributes.depth, width, height);
+}
+
+bool PixelSnifferX11::prepareRegions(const std::vector<Box>& regions)
+{
+  // Return the segments of the current regions to the pool first, such that the new regions can reuse them.
+  regions_.clear();
+  std::vector<ImageX11Regions::Region> prepared;
+  for (const auto& box : regions)
+  {
+    // Clamp the region to the capture area.
+    Box clamped = box;
+    clamped.x_max = std::min<size_t>(clamped.x_max, ximage_->width);
+    clamped.y_max = std::min<size_t>(clamped.y_max, ximage_->height);
+    if ((clamped.x_min >= clamped.x_max) || (clamped.y_min >= clamped.y_max))
+    {
+      continue;
+    }
+    auto image = createSharedImage(clamped.width(), clamped.height());
+    if (!image)
+    {
+      return false;
+    }
+    prepared.push_back({ clamped, image });
+  }
+  regions_ = std::move(prepared);
+  return true;
+}
+
 bool PixelSnifferX11::grabContent()
 {
   // Lets disable these for now; they raise and map the window, giving best opportunity to be able to capture.
@@ -211,7 +611,19 @@ bool PixelSnifferX11::grabContent()
   //  XMapRaised(display_, window_);
   try
   {
-    XShmGetImage(display_, window_, ximage_.get(), capture_x_, capture_y_, AllPlanes);
+    if (!processWindowEvents())
+    {
+      return false;
+    }
+    if (regions_.empty())
+    {
+      XShmGetImage(display_, window_, ximage_.get(), capture_x_, capture_y_, AllPlanes);
+    }
+    for (const auto& region : regions_)
+    {
+      XShmGetImage(display_, window_, region.image.get(), capture_x_ + region.box.x_min,
+                   capture_y_ + region.box.y_min, AllPlanes);
+    }
   }
   catch (const std::runtime_error& e)
   {
@@ -223,17 +635,20 @@ bool PixelSnifferX11::grabContent()
 
 Image::Ptr PixelSnifferX11::getScreen()
 {
+  if (!regions_.empty())
+  {
+    return std::make_shared<ImageX11Regions>(ximage_->width, ximage_->height, regions_);
+  }
   return std::make_shared<ImageX11>(ximage_);
 }
 
+const SharedMemoryPool& PixelSnifferX11::getSharedMemoryPool() const
+{
+  return *pool_;
+}
+
 PixelSniffer::Resolution PixelSnifferX11::getFullResolution()
 {
-  int x_return, y_return;
-  unsigned int width_return, height_return;
-  unsigned int border_width_return;
-  unsigned int depth_return;
-  Window root_return = XDefaultRootWindow(display_);
-  XGetGeometry(display_, root_window_, &root_return, &x_return, &y_return, &width_return, &height_return, &border_width_return,
-               &depth_return);  // return code is discarded, can throw BadDrawable.
-  return Resolution(width_return, height_return);
+  processRootEvents();
+  return resolution_;
 }
@@ -20,6 +20,8 @@
 #ifndef PIXELSNIFFX11_H
 #define PIXELSNIFFX11_H
 
+#include <chrono>
+
 #include "imageX11.h"
 #include "pixelsniff.h"
 
@@ -35,6 +37,13 @@
 
 // For shared memory extension
 #include <X11/extensions/XShm.h>
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#endif
+#ifdef HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
 #include <sys/ipc.h>
 #include <sys/shm.h>
 
@@ -63,6 +72,72 @@ private:
   void getResolution();  //!< Retrieve the windows resolution.
 };
 
+/**
+ * @brief Pool of shared memory segments that are attached to the X server. Images are handed out backed by a free
+ *        segment that is large enough, when the image is destroyed its segment returns to the pool. This way changing
+ *        the capture area reuses the segments instead of creating and attaching new ones. Each segment is marked for
+ *        removal as soon as the server attached it, so the system releases it once both sides detached, even if this
+ *        process is killed.
+ */
+class SharedMemoryPool
+{
+public:
+  /**
+   * @brief Create an empty pool for the provided display.
+   */
+  SharedMemoryPool(Display* display);
+
+  /**
+   * @brief Return an XImage backed by a free segment of sufficient size. If there is no such segment a free one that
+   *        is too small is replaced by a larger one, or a new segment is added.
+   * @return The image, nullptr if an error occured.
+   */
+  std::shared_ptr<XImage> acquire(Visual* visual, unsigned int depth, size_t width, size_t height);
+
+  /**
+   * @brief Return the number of segments in the pool.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Return the number of segments that are backing an image.
+   */
+  size_t inUse() const;
+
+  /**
+   * @brief Return the total size of the segments in the pool, in bytes.
+   */
+  size_t bytes() const;
+
+  /**
+   * @brief Return the number of segments that were created since the pool was created.
+   */
+  size_t created() const;
+
+private:
+  /**
+   * @brief A shared memory segment attached to both the X server and this process, detached when destroyed.
+   */
+  struct Segment
+  {
+    /**
+     * @brief Create and attach a segment of the provided size.
+     * @return The segment, nullptr if an error occured.
+     */
+    static std::shared_ptr<Segment> create(Display* display, size_t size);
+    ~Segment();
+
+    Display* display;      //!< The display the segment is attached to.
+    XShmSegmentInfo info;  //!< The segment, as known to the shared memory extension.
+    size_t size;           //!< Size of the segment in bytes.
+    bool in_use{ false };  //!< True if the segment is backing an image.
+  };
+
+  Display* display_;                                //!< The display the segments are attached to.
+  std::vector<std::shared_ptr<Segment>> segments_;  //!< The segments in the pool.
+  size_t created_{ 0 };                             //!< Number of segments created.
+};
+
 class PixelSnifferX11 : public PixelSniffer
 {
 public:
@@ -80,7 +155,9 @@ public:
   bool selectRootWindow();
 
   /**
-   * @brief Select a specific window to capture from, use getWindows() to obtain a list of input arguments.
+   * @brief Select a specific window to capture from, use getWindows() to obtain a list of input arguments. The window
+   *        is followed through X events; the capture is prepared again when its size changes and if it is destroyed a
+   *        window with the same name is selected once it appears.
    * @return False if an error occured.
    */
   bool selectWindow(const WindowInfo& window);
@@ -110,17 +187,109 @@ public:
    */
   bool prepareCapture(size_t x = 0, size_t y = 0, size_t width = 0, size_t height = 0);
 
+  /**
+   * @brief Only capture these regions of the capture area, each into its own shared memory image. The screen exposes
+   *        them as one image with the dimensions of the capture area. This reduces the bandwidth of each grab, not the
+   *        memory; the image of the entire capture area stays allocated to fall back to.
+   * @param regions The regions to capture, in coordinates of the capture area. Empty to capture the entire area.
+   */
+  bool prepareRegions(const std::vector<Box>& regions);
+
+  /**
+   * @brief Enable or disable tracking damage through the X Damage extension, the X server only tracks the captured
+   *        window while this is enabled.
+   * @return False if the Damage extension is not available.
+   */
+  bool setDamageTracking(bool enabled);
+
+  /**
+   * @brief Retrieve the regions of the capture area that changed since the previous call, as reported by the X Damage
+   *        extension. The first call after prepareCapture() reports the entire capture area.
+   * @return False if the Damage extension is not available or tracking is disabled.
+   */
+  bool getDamage(std::vector<Box>& damage);
+
+  /**
+   * @brief Return the full resolution of the desktop. This is cached, it is only updated when the X server notifies
+   *        that the root window changed, so this doesn't require a round trip to the server.
+   */
   Resolution getFullResolution();
+
+  /**
+   * @brief Return the pool of shared memory segments that back the captured images.
+   */
+  const SharedMemoryPool& getSharedMemoryPool() const;
+
 protected:
-  Display* display_;                //!< Pointer to the current X display.
-  std::shared_ptr<XImage> ximage_;  //!< Pointer to ximage representing data.
-  XShmSegmentInfo shminfo_;         //!< Context for the shared memory extnesion.
-  Window root_window_;              //!< The root window of the X display.
-  Window window_;                   //!< The current window we are grabbing from.
+  Display* display_;                        //!< Pointer to the current X display.
+  std::shared_ptr<XImage> ximage_;          //!< Pointer to ximage representing data.
+  std::unique_ptr<SharedMemoryPool> pool_;  //!< Shared memory segments backing the images.
+  Window root_window_{ 0 };                 //!< The root window of the X display.
+  Window window_{ 0 };                      //!< The current window we are grabbing from.
 
   size_t capture_x_;  //!< The x position to grab from.
   size_t capture_y_;  //!< The y position to grab from.
 
+  size_t requested_x_{ 0 };       //!< The x position passed to prepareCapture.
+  size_t requested_y_{ 0 };       //!< The y position passed to prepareCapture.
+  size_t requested_width_{ 0 };   //!< The width passed to prepareCapture, 0 for the window width.
+  size_t requested_height_{ 0 };  //!< The height passed to prepareCapture, 0 for the window height.
+  Resolution window_size_;        //!< Size of the window at the last prepareCapture.
+
+  std::string window_name_;                             //!< Name of the selected window, to find it again.
+  bool window_lost_{ false };                           //!< True if the window was destroyed, not found again yet.
+  std::chrono::steady_clock::time_point rematch_time_;  //!< Time of the last attempt to find the window again.
+
+  std::vector<ImageX11Regions::Region> regions_;  //!< Regions to capture, empty if the entire area is captured.
+  Resolution resolution_;                         //!< Cached resolution of the root window.
+
+  /**
+   * @brief Process the pending notifications about changes to the root window, updating the cached resolution.
+   */
+  void processRootEvents();
+
+  /**
+   * @brief Process the pending notifications about the selected window, preparing the capture again if its size
+   *        changed and looking for its replacement if it was destroyed.
+   * @return False if there is no window to capture from.
+   */
+  bool processWindowEvents();
+
+  /**
+   * @brief Look for a window with the name of the lost window and select it, at most once per second.
+   * @return True if the window was found.
+   */
+  bool rematchWindow();
+
+  /**
+   * @brief Start or stop following the structure of the provided window, the root window is always followed.
+   */
+  void followWindow(Window window, bool follow);
+
+#ifdef HAVE_XRANDR
+  bool randr_available_{ false };  //!< True if the RandR extension is present.
+  int randr_event_base_{ 0 };      //!< Event number of the RandR extension's events.
+#endif
+#ifdef HAVE_XDAMAGE
+  bool damage_available_{ false };  //!< True if the Damage extension is present.
+  int damage_event_base_{ 0 };      //!< Event number of the Damage extension's events.
+  Damage damage_{ 0 };              //!< Damage object tracking the captured window.
+  bool damaged_entirely_{ true };   //!< Report the entire capture area as damaged on the next call.
+  bool damage_tracking_{ false };   //!< True if damage is tracked.
+
+  /**
+   * @brief Destroy the damage object and create one for the current window if tracking is enabled.
+   */
+  void trackDamage();
+#endif
+
+  /**
+   * @brief Create an XImage for the current window, backed by a shared memory segment from the pool. The segment
+   *        returns to the pool when the image is destroyed.
+   * @return The image, nullptr if an error occured.
+   */
+  std::shared_ptr<XImage> createSharedImage(size_t width, size_t height);
+
   /**
    * @brief Function to recurse down the window tree, populating the window information structs.
    */
@@ -0,0 +1,128 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "pixelsniffY4M.h"
+
+PixelSnifferY4M::Frame::Frame(size_t width, size_t height)
+  : Image(Bitmap(height, std::vector<uint32_t>(width, 0)))
+{
+}
+
+Image::Bitmap& PixelSnifferY4M::Frame::bitmap()
+{
+  return map_;
+}
+
+PixelSnifferY4M::PixelSnifferY4M(const std::string& filename, bool realtime, bool loop)
+  : reader_(filename)
+  , realtime_(realtime)
+  , loop_(loop)
+  , screen_(std::make_shared<Frame>(reader_.width(), reader_.height()))
+{
+}
+
+void PixelSnifferY4M::connect()
+{
+}
+
+bool PixelSnifferY4M::selectRootWindow()
+{
+  return true;
+}
+
+bool PixelSnifferY4M::prepareCapture(size_t, size_t, size_t, size_t)
+{
+  return true;
+}
+
+bool PixelSnifferY4M::next(bool convert)
+{
+  if (convert ? reader_.read(screen_->bitmap()) : reader_.skip())
+  {
+    position_++;
+    return true;
+  }
+  return false;
+}
+
+bool PixelSnifferY4M::restart()
+{
+  if (!loop_ || !position_)
+  {
+    return false;  // A video without frames can't loop either.
+  }
+  reader_.rewind();
+  position_ = 0;
+  start_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool PixelSnifferY4M::grabContent()
+{
+  if (finished_)
+  {
+    return false;
+  }
+
+  if (realtime_ && grabbed_)
+  {
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+    const size_t due = static_cast<size_t>(elapsed.count() * reader_.frameRate());
+    if (due < position_)
+    {
+      grabbed_++;
+      return true;  // The current frame is still shown.
+    }
+    // Skip the frames that passed, the video can only be read forwards.
+    while ((position_ < due) && next(false))
+    {
+    }
+  }
+  if (!next(true) && !(restart() && next(true)))
+  {
+    finished_ = true;
+    return false;
+  }
+  if (grabbed_ == 0)
+  {
+    start_ = std::chrono::steady_clock::now();
+  }
+  grabbed_++;
+  return true;
+}
+
+Image::Ptr PixelSnifferY4M::getScreen()
+{
+  return screen_;
+}
+
+PixelSniffer::Resolution PixelSnifferY4M::getFullResolution()
+{
+  return { reader_.width(), reader_.height() };
+}
+
+bool PixelSnifferY4M::finished() const
+{
+  return finished_;
+}
+
+size_t PixelSnifferY4M::grabbed() const
+{
+  return grabbed_;
+}
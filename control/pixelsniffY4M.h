@@ -0,0 +1,89 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef PIXELSNIFFY4M_H
+#define PIXELSNIFFY4M_H
+
+#include <chrono>
+#include "pixelsniff.h"
+#include "y4m.h"
+
+/**
+ * @brief Pixel sniffer that plays a YUV4MPEG2 video instead of capturing the screen, for running the analysis over
+ *        reference clips. The video is streamed, one frame is in memory at any time.
+ *
+ * In real time mode each grab returns the frame that is due at the frame rate of the video, frames are skipped or
+ * repeated as needed. Otherwise each grab returns the next frame, as fast as they are requested. The video is the
+ * entire capture area, prepareCapture() doesn't crop it.
+ */
+class PixelSnifferY4M : public PixelSnifferPlayback
+{
+public:
+  /**
+   * @brief Open a video, throws a std::runtime_error if it can't be read.
+   * @param filename The video to play.
+   * @param realtime Play at the frame rate of the video, otherwise each grab returns the next frame.
+   * @param loop Restart at the first frame after the last one, otherwise grabContent() fails at the end.
+   */
+  PixelSnifferY4M(const std::string& filename, bool realtime = true, bool loop = false);
+
+  void connect();
+  bool selectRootWindow();
+  bool grabContent();
+  Image::Ptr getScreen();
+  bool prepareCapture(size_t x = 0, size_t y = 0, size_t width = 0, size_t height = 0);
+  Resolution getFullResolution();
+  bool finished() const;
+  size_t grabbed() const;
+
+private:
+  /**
+   * @brief Image that the frames of the video are converted into.
+   */
+  class Frame : public Image
+  {
+  public:
+    Frame(size_t width, size_t height);
+    Bitmap& bitmap();
+  };
+
+  Y4MReader reader_;                             //!< The video being played.
+  bool realtime_;                                //!< Play at the frame rate of the video.
+  bool loop_;                                    //!< Restart after the last frame.
+  size_t position_{ 0 };                         //!< Frames read since the video (re)started.
+  size_t grabbed_{ 0 };                          //!< Number of grabs performed.
+  bool finished_{ false };                       //!< True if the end of the video is reached.
+  std::chrono::steady_clock::time_point start_;  //!< Time at which the first frame is shown in real time mode.
+  std::shared_ptr<Frame> screen_;                //!< The current frame.
+
+  /**
+   * @brief Advance to the next frame.
+   * @param convert Convert the frame into the screen, otherwise it is skipped.
+   * @return False at the end of the video.
+   */
+  bool next(bool convert);
+
+  /**
+   * @brief Start at the first frame again if the video loops.
+   * @return False if the video doesn't loop.
+   */
+  bool restart();
+};
+
+#endif
@@ -0,0 +1,367 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "recording.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+const char Recorder::file_magic[8] = { 'D', 'L', 'R', 'E', 'C', '0', '0', '1' };
+const char Recorder::index_magic[8] = { 'D', 'L', 'I', 'N', 'D', 'E', 'X', '1' };
+
+// The encoded pixels are a sequence of runs, each starts with a varint holding the length and the kind of run.
+static constexpr const uint32_t run_zero = 0;     //!< Pixels that are identical to the previous frame.
+static constexpr const uint32_t run_literal = 1;  //!< Differences that follow, three bytes each.
+static constexpr const uint32_t run_repeat = 2;   //!< A single difference that follows, repeated for all pixels.
+
+/**
+ * @brief Append a variable length integer, seven bits per byte, the high bit is set if more bytes follow.
+ */
+static void putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * @brief Read a variable length integer, returns false if the data ends before it does.
+ */
+static bool getVarint(const uint8_t*& pos, const uint8_t* end, uint64_t& value)
+{
+  value = 0;
+  for (size_t shift = 0; (pos != end) && (shift < 64); shift += 7)
+  {
+    const uint8_t byte = *pos++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Append the three color bytes of a pixel.
+ */
+static void putPixel(std::vector<uint8_t>& out, uint32_t pixel)
+{
+  out.push_back(pixel >> 16);
+  out.push_back(pixel >> 8);
+  out.push_back(pixel);
+}
+
+Recorder::Recorder(const std::string& filename, size_t border, size_t keyframe_interval)
+  : file_(filename, std::ios::binary | std::ios::trunc), border_(border), keyframe_interval_(keyframe_interval)
+{
+  if (!file_)
+  {
+    throw std::runtime_error("Failed to open " + filename);
+  }
+  if (keyframe_interval_ == 0)
+  {
+    keyframe_interval_ = 1;
+  }
+  file_.write(file_magic, sizeof(file_magic));
+  bytes_ = sizeof(file_magic);
+}
+
+Recorder::~Recorder()
+{
+  close();
+}
+
+void Recorder::add(const Image& image, uint64_t timestamp_us, size_t full_width, size_t full_height)
+{
+  if (!file_.is_open())
+  {
+    return;
+  }
+  const size_t width = image.getWidth();
+  const size_t height = image.getHeight();
+  const bool keyframe = (index_.size() % keyframe_interval_ == 0) || (previous_.size() != height) ||
+                        (previous_.empty() ? false : previous_.front().size() != width);
+  if (keyframe)
+  {
+    previous_.assign(height, std::vector<uint32_t>(width, 0));
+  }
+
+  // Determine the difference of each pixel that is stored, the others are black.
+  deltas_.resize(width * height);
+  size_t pos = 0;
+  for (size_t y = 0; y < height; y++)
+  {
+    const bool border_row = (border_ == 0) || (y < border_) || (y + border_ >= height);
+    auto& previous_row = previous_[y];
+    for (size_t x = 0; x < width; x++)
+    {
+      const bool stored = border_row || (x < border_) || (x + border_ >= width);
+      const uint32_t value = stored ? (image.pixel(x, y) & 0x00FFFFFF) : 0;
+      deltas_[pos++] = value ^ previous_row[x];
+      previous_row[x] = value;
+    }
+  }
+
+  // Run length encode the differences.
+  payload_.clear();
+  const size_t n = deltas_.size();
+  size_t i = 0;
+  while (i < n)
+  {
+    size_t j = i + 1;
+    if (deltas_[i] == 0)
+    {
+      while ((j < n) && (deltas_[j] == 0))
+      {
+        j++;
+      }
+      putVarint(payload_, ((j - i) << 2) | run_zero);
+      i = j;
+      continue;
+    }
+    while ((j < n) && (deltas_[j] == deltas_[i]))
+    {
+      j++;
+    }
+    if (j - i >= 3)
+    {
+      putVarint(payload_, ((j - i) << 2) | run_repeat);
+      putPixel(payload_, deltas_[i]);
+      i = j;
+      continue;
+    }
+    // Literal differences, until a zero or a repetition starts.
+    j = i + 1;
+    while ((j < n) && (deltas_[j] != 0) &&
+           !((j + 2 < n) && (deltas_[j] == deltas_[j + 1]) && (deltas_[j] == deltas_[j + 2])))
+    {
+      j++;
+    }
+    putVarint(payload_, ((j - i) << 2) | run_literal);
+    for (size_t k = i; k < j; k++)
+    {
+      putPixel(payload_, deltas_[k]);
+    }
+    i = j;
+  }
+
+  FrameHeader header;
+  header.magic = frame_magic;
+  header.flags = (keyframe ? flag_keyframe : 0) | (border_ ? flag_border_only : 0);
+  header.timestamp_us = timestamp_us;
+  header.width = width;
+  header.height = height;
+  header.full_width = full_width;
+  header.full_height = full_height;
+  header.border = border_;
+  header.payload_size = payload_.size();
+
+  index_.push_back(IndexEntry{ bytes_, timestamp_us, header.flags, 0 });
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file_.write(reinterpret_cast<const char*>(payload_.data()), payload_.size());
+  bytes_ += sizeof(header) + payload_.size();
+}
+
+void Recorder::close()
+{
+  if (!file_.is_open())
+  {
+    return;
+  }
+  const uint64_t index_offset = bytes_;
+  const uint64_t count = index_.size();
+  file_.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  file_.write(reinterpret_cast<const char*>(index_.data()), index_.size() * sizeof(IndexEntry));
+  file_.write(reinterpret_cast<const char*>(&index_offset), sizeof(index_offset));
+  file_.write(index_magic, sizeof(index_magic));
+  bytes_ += sizeof(count) + index_.size() * sizeof(IndexEntry) + sizeof(index_offset) + sizeof(index_magic);
+  file_.close();
+}
+
+size_t Recorder::size() const
+{
+  return index_.size();
+}
+
+size_t Recorder::bytes() const
+{
+  return bytes_;
+}
+
+Recording::Recording(const std::string& filename) : file_(filename, std::ios::binary)
+{
+  char magic[8];
+  if (!file_.read(magic, sizeof(magic)) || std::memcmp(magic, Recorder::file_magic, sizeof(magic)))
+  {
+    throw std::runtime_error("Not a recording: " + filename);
+  }
+
+  // Use the index if the recording was closed, otherwise walk the frames.
+  uint64_t index_offset = 0;
+  uint64_t count = 0;
+  file_.seekg(-static_cast<std::streamoff>(sizeof(index_offset) + sizeof(magic)), std::ios::end);
+  if (file_.read(reinterpret_cast<char*>(&index_offset), sizeof(index_offset)) && file_.read(magic, sizeof(magic)) &&
+      !std::memcmp(magic, Recorder::index_magic, sizeof(magic)) && file_.seekg(index_offset) &&
+      file_.read(reinterpret_cast<char*>(&count), sizeof(count)))
+  {
+    index_.resize(count);
+    file_.read(reinterpret_cast<char*>(index_.data()), count * sizeof(Recorder::IndexEntry));
+  }
+  if (!file_ || index_.empty())
+  {
+    index_.clear();
+    file_.clear();
+    scan();
+  }
+  current_ = index_.size();
+}
+
+void Recording::scan()
+{
+  file_.seekg(0, std::ios::end);
+  const uint64_t end = file_.tellg();
+  uint64_t offset = sizeof(Recorder::file_magic);
+  Recorder::FrameHeader header;
+  while (file_.seekg(offset) && file_.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+         (header.magic == Recorder::frame_magic) && (offset + sizeof(header) + header.payload_size <= end))
+  {
+    index_.push_back(Recorder::IndexEntry{ offset, header.timestamp_us, header.flags, 0 });
+    offset += sizeof(header) + header.payload_size;
+  }
+  file_.clear();
+}
+
+size_t Recording::size() const
+{
+  return index_.size();
+}
+
+uint64_t Recording::timestamp(size_t index) const
+{
+  return index_.at(index).timestamp_us;
+}
+
+Recording::Resolution Recording::getFullResolution() const
+{
+  return full_resolution_;
+}
+
+const Image::Bitmap& Recording::read(size_t index)
+{
+  if (index >= index_.size())
+  {
+    throw std::out_of_range("Frame " + std::to_string(index) + " is not in the recording.");
+  }
+  if (index == current_)
+  {
+    return frame_;
+  }
+
+  // Find the frame to start decoding from; the next one if that's the requested one, otherwise the keyframe.
+  size_t start = index;
+  if ((current_ >= index_.size()) || (index != current_ + 1))
+  {
+    while ((start > 0) && !(index_[start].flags & Recorder::flag_keyframe))
+    {
+      start--;
+    }
+  }
+  for (size_t i = start; i <= index; i++)
+  {
+    decode(i);
+  }
+  current_ = index;
+  return frame_;
+}
+
+void Recording::decode(size_t index)
+{
+  Recorder::FrameHeader header;
+  file_.seekg(index_[index].offset);
+  file_.read(reinterpret_cast<char*>(&header), sizeof(header));
+  payload_.resize(header.payload_size);
+  file_.read(reinterpret_cast<char*>(payload_.data()), payload_.size());
+  if (!file_ || (header.magic != Recorder::frame_magic))
+  {
+    file_.clear();
+    throw std::runtime_error("Failed to read frame " + std::to_string(index));
+  }
+
+  const size_t width = header.width;
+  const size_t height = header.height;
+  if (header.flags & Recorder::flag_keyframe)
+  {
+    frame_.assign(height, std::vector<uint32_t>(width, 0));
+  }
+  else if ((frame_.size() != height) || (height && (frame_.front().size() != width)))
+  {
+    throw std::runtime_error("Frame " + std::to_string(index) + " doesn't match the preceding frame.");
+  }
+  full_resolution_ = Resolution(header.full_width, header.full_height);
+
+  // Apply the runs of differences to the frame.
+  const uint8_t* pos = payload_.data();
+  const uint8_t* end = pos + payload_.size();
+  size_t x = 0;
+  size_t y = 0;
+  while (pos != end)
+  {
+    uint64_t token;
+    if (!getVarint(pos, end, token))
+    {
+      break;
+    }
+    const uint32_t kind = token & 0x3;
+    size_t count = token >> 2;
+    if (kind == run_zero)
+    {
+      const size_t advanced = x + count;
+      y += advanced / std::max<size_t>(width, 1);
+      x = advanced % std::max<size_t>(width, 1);
+      continue;
+    }
+    uint32_t delta = 0;
+    for (; count != 0; count--)
+    {
+      if ((kind == run_literal) || (count == (token >> 2)))
+      {
+        if (end - pos < 3)
+        {
+          throw std::runtime_error("Frame " + std::to_string(index) + " is truncated.");
+        }
+        delta = (pos[0] << 16) | (pos[1] << 8) | pos[2];
+        pos += 3;
+      }
+      if (y >= height)
+      {
+        throw std::runtime_error("Frame " + std::to_string(index) + " holds too many pixels.");
+      }
+      frame_[y][x] ^= delta;
+      if (++x == width)
+      {
+        x = 0;
+        y++;
+      }
+    }
+  }
+}
@@ -0,0 +1,180 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "image.h"
+
+/**
+ * @brief Writes captured frames with their timestamps into a recording file.
+ *
+ * Each frame is stored as the difference to the previous frame, every keyframe_interval frames a frame is stored in
+ * full such that a reader can start decoding there. The differences are run length encoded; unchanged pixels cost
+ * nearly nothing, as do areas of a single color. Optionally only the border strips of the frame are stored, the
+ * remainder of the frame is recorded as black.
+ *
+ * The file starts with a magic, followed by the frames. Each frame is a header followed by its encoded pixels. On
+ * close() an index of all frames is appended, followed by a trailer that points to it. If a recording is never closed
+ * the reader rebuilds the index by walking the frames.
+ */
+class Recorder
+{
+public:
+  /**
+   * @brief Create a recording.
+   * @param filename The file to write to, it is overwritten.
+   * @param border If non-zero, only the pixels within this distance from the edges of the frame are stored.
+   * @param keyframe_interval Store a full frame every this many frames.
+   */
+  Recorder(const std::string& filename, size_t border = 0, size_t keyframe_interval = 60);
+
+  /**
+   * @brief Closes the recording.
+   */
+  ~Recorder();
+
+  /**
+   * @brief Add a frame to the recording.
+   * @param image The captured image.
+   * @param timestamp_us The time at which it was captured, in microseconds.
+   * @param full_width The width of the desktop the image was captured from.
+   * @param full_height The height of the desktop the image was captured from.
+   */
+  void add(const Image& image, uint64_t timestamp_us, size_t full_width, size_t full_height);
+
+  /**
+   * @brief Write the index and close the file, no frames can be added afterwards.
+   */
+  void close();
+
+  /**
+   * @brief Return the number of frames added.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Return the number of bytes written so far.
+   */
+  size_t bytes() const;
+
+  /**
+   * @brief Header preceding each frame in the file.
+   */
+  struct FrameHeader
+  {
+    uint32_t magic;         //!< Marks the start of a frame.
+    uint32_t flags;         //!< Keyframe and border only flags.
+    uint64_t timestamp_us;  //!< Capture time of the frame.
+    uint32_t width;         //!< Width of the frame.
+    uint32_t height;        //!< Height of the frame.
+    uint32_t full_width;    //!< Width of the desktop the frame was captured from.
+    uint32_t full_height;   //!< Height of the desktop the frame was captured from.
+    uint32_t border;        //!< Depth of the border strips that are stored, 0 if the entire frame is stored.
+    uint32_t payload_size;  //!< Number of bytes of encoded pixels that follow.
+  };
+
+  /**
+   * @brief An entry in the index at the end of the file.
+   */
+  struct IndexEntry
+  {
+    uint64_t offset;        //!< Position of the frame header in the file.
+    uint64_t timestamp_us;  //!< Capture time of the frame.
+    uint32_t flags;         //!< Flags of the frame.
+    uint32_t reserved;      //!< Padding.
+  };
+
+  static constexpr const uint32_t frame_magic{ 0x454d5246 };  //!< "FRME"
+  static constexpr const uint32_t flag_keyframe{ 1 << 0 };     //!< The frame is not relative to the previous frame.
+  static constexpr const uint32_t flag_border_only{ 1 << 1 };  //!< Only the border strips are stored.
+  static const char file_magic[8];                             //!< Start of the file.
+  static const char index_magic[8];                            //!< End of the trailer.
+
+private:
+  std::ofstream file_;             //!< The file written to.
+  size_t border_;                  //!< Depth of the border strips to store, 0 for everything.
+  size_t keyframe_interval_;       //!< Frames between keyframes.
+  Image::Bitmap previous_;         //!< The previous frame as it is stored.
+  std::vector<uint32_t> deltas_;   //!< Difference of each pixel to the previous frame.
+  std::vector<uint8_t> payload_;   //!< The encoded frame.
+  std::vector<IndexEntry> index_;  //!< Index entry of each frame.
+  size_t bytes_{ 0 };              //!< Number of bytes written.
+};
+
+/**
+ * @brief Reads the frames from a recording made by the Recorder.
+ */
+class Recording
+{
+public:
+  using Resolution = std::pair<std::size_t, std::size_t>;
+
+  /**
+   * @brief Open a recording, throws a std::runtime_error if it can't be read.
+   */
+  Recording(const std::string& filename);
+
+  /**
+   * @brief Return the number of frames in the recording.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Return the timestamp of a frame, in microseconds.
+   */
+  uint64_t timestamp(size_t index) const;
+
+  /**
+   * @brief Decode a frame. Reading the frames in order only decodes each frame once, otherwise decoding starts at the
+   *        closest preceding keyframe.
+   * @return The frame, it is overwritten by the next call.
+   */
+  const Image::Bitmap& read(size_t index);
+
+  /**
+   * @brief Return the resolution of the desktop that the last frame read was captured from.
+   */
+  Resolution getFullResolution() const;
+
+private:
+  /**
+   * @brief Decode a frame on top of the frame that preceded it.
+   */
+  void decode(size_t index);
+
+  /**
+   * @brief Rebuild the index by walking all frames, for recordings that weren't closed.
+   */
+  void scan();
+
+  std::ifstream file_;                       //!< The recording.
+  std::vector<Recorder::IndexEntry> index_;  //!< Index entry of each frame.
+  Image::Bitmap frame_;                      //!< The last frame decoded.
+  size_t current_;                           //!< Index of the last frame decoded, size() if none.
+  Resolution full_resolution_;               //!< Desktop resolution of the last frame decoded.
+  std::vector<uint8_t> payload_;             //!< Buffer for the encoded frame.
+};
+
+#endif
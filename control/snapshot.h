@@ -0,0 +1,88 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief Publishes copies of a value to readers on other threads without locks, a sequence lock. Publishing never
+ *        waits for readers, a reader retries if a copy was published while it was reading. Publishers must not run
+ *        concurrently with each other.
+ */
+template <typename T>
+class Snapshot
+{
+  static_assert(std::is_trivially_copyable<T>::value, "The value is copied word by word.");
+
+public:
+  /**
+   * @brief Publish a copy of the value.
+   */
+  void store(const T& value)
+  {
+    std::array<uint64_t, word_count> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+    const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);  // Odd while the copy is being written.
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < word_count; i++)
+    {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  /**
+   * @brief Return the last published copy of the value.
+   */
+  T load() const
+  {
+    std::array<uint64_t, word_count> words;
+    uint64_t before = 0;
+    uint64_t after = 0;
+    do
+    {
+      before = sequence_.load(std::memory_order_acquire);
+      for (size_t i = 0; i < word_count; i++)
+      {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence_.load(std::memory_order_relaxed);
+    } while ((before & 1) || (before != after));
+    T value;
+    std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+    return value;
+  }
+
+private:
+  static constexpr const size_t word_count{ (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t) };
+
+  std::atomic<uint64_t> sequence_{ 0 };                    //!< Incremented before and after publishing a copy.
+  std::array<std::atomic<uint64_t>, word_count> words_{};  //!< The published copy.
+};
+
+#endif
@@ -17,8 +17,10 @@
   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
   SOFTWARE.
 */
+#include <algorithm>
 #include <chrono>
 #include <fstream>
+#include "analyzer.h"
 #include "pixelsniffX11.h"
 #include "timing.h"
 
@@ -33,6 +35,10 @@ int main(int argc, char* argv[])
     std::cout << "" << argv[0] << " grabwindow string_in_title [content.ppm]" << std::endl;
     std::cout << "" << argv[0] << " grabroot [content.ppm]" << std::endl;
     std::cout << "" << argv[0] << " grabpart string_in_title [content.ppm] x y w h " << std::endl;
+    std::cout << "" << argv[0] << " edges [frames]" << std::endl;
+    std::cout << "" << argv[0] << " damage [frames]" << std::endl;
+    std::cout << "" << argv[0] << " switch [cycles]" << std::endl;
+    std::cout << "" << argv[0] << " follow string_in_title [frames]" << std::endl;
     return 1;
   }
 
@@ -55,6 +61,166 @@ int main(int argc, char* argv[])
     std::cout << "Captures done:" << count << " avg: " << time.average() << " usec" << std::endl;
   }
 
+  // Compare capturing only the regions the analyzer reads against capturing the entire root window.
+  if ((std::string(argv[1]) == "edges"))
+  {
+    const size_t count = (argc >= 3) ? std::atoi(argv[2]) : 100;
+    Analyzer analyzer;
+    sniff.selectRootWindow();
+
+    // Analyze the entire screen.
+    Measure full_time;
+    for (size_t c = 0; c < count; c++)
+    {
+      full_time.start();
+      sniff.grabContent();
+      full_time.stop();
+    }
+    auto full = sniff.getScreen();
+    const Box bounds = analyzer.findBorders(*full);
+    const auto samples = analyzer.makeBoxSamples(15, bounds);
+    auto full_canvas = analyzer.makeCanvas();
+    analyzer.sample(*full, bounds, samples, full_canvas);
+    full->convertToBitmap();  // Keep these pixels, the shared memory is overwritten by the next grab.
+
+    // Analyze only the regions.
+    const auto regions = analyzer.captureRegions(full->getWidth(), full->getHeight(), bounds);
+    if (!sniff.prepareRegions(regions))
+    {
+      std::cerr << "Failed to prepare the regions" << std::endl;
+      return 1;
+    }
+    Measure edge_time;
+    for (size_t c = 0; c < count; c++)
+    {
+      edge_time.start();
+      sniff.grabContent();
+      edge_time.stop();
+    }
+    auto edges = sniff.getScreen();
+    const Box edge_bounds = analyzer.findBorders(*edges);
+    auto edge_canvas = analyzer.makeCanvas();
+    analyzer.sample(*edges, edge_bounds, samples, edge_canvas);
+
+    size_t region_pixels = 0;
+    for (const auto& region : regions)
+    {
+      region_pixels += region.width() * region.height();
+    }
+    const size_t full_pixels = full->getWidth() * full->getHeight();
+    std::cout << "Full: " << full_pixels * 4 << " bytes per frame, avg: " << full_time.average() << " usec"
+              << std::endl;
+    std::cout << "Edges: " << region_pixels * 4 << " bytes per frame in " << regions.size()
+              << " regions, avg: " << edge_time.average() << " usec" << std::endl;
+
+    // The screen is assumed to be static during the test, the analysis must be identical.
+    size_t differences = (edge_bounds == bounds) ? 0 : 1;
+    for (size_t i = 0; i < full_canvas.size(); i++)
+    {
+      differences += (full_canvas[i].toUint32() != edge_canvas[i].toUint32());
+    }
+    std::cout << "Bounds: " << std::string(bounds) << " edges: " << std::string(edge_bounds)
+              << " differences: " << differences << std::endl;
+    return differences ? 1 : 0;
+  }
+
+  // Poll the damage of the root window at 60 Hz, report how often a capture would be needed.
+  if ((std::string(argv[1]) == "damage"))
+  {
+    const size_t count = (argc >= 3) ? std::atoi(argv[2]) : 600;
+    sniff.selectRootWindow();
+    Limiter limiter{ 60 };
+    Measure poll;
+    size_t damaged = 0;
+    size_t rectangles = 0;
+    size_t area = 0;
+    std::vector<Box> damage;
+    for (size_t c = 0; c < count; c++)
+    {
+      limiter.sleep();
+      poll.start();
+      if (!sniff.getDamage(damage))
+      {
+        std::cerr << "Damage extension not available." << std::endl;
+        return 1;
+      }
+      poll.stop();
+      damaged += !damage.empty();
+      rectangles += damage.size();
+      for (const auto& box : damage)
+      {
+        area += box.width() * box.height();
+      }
+    }
+    std::cout << "Frames: " << count << " damaged: " << damaged << " rectangles: " << rectangles
+              << " pixels: " << area << " poll avg: " << poll.average() << " usec" << std::endl;
+    return 0;
+  }
+
+  // Alternate between two capture areas, the shared memory segments should be reused instead of created each time.
+  if ((std::string(argv[1]) == "switch"))
+  {
+    const size_t count = (argc >= 3) ? std::atoi(argv[2]) : 1000;
+    sniff.selectRootWindow();
+    const auto res = sniff.getFullResolution();
+    Measure prepare;
+    for (size_t c = 0; c < count; c++)
+    {
+      prepare.start();
+      const bool success = (c % 2) ? sniff.prepareCapture() : sniff.prepareCapture(0, 0, res.first / 2, res.second);
+      prepare.stop();
+      if (!success || !sniff.grabContent())
+      {
+        std::cerr << "Failed to prepare or grab" << std::endl;
+        return 1;
+      }
+    }
+    const auto& pool = sniff.getSharedMemoryPool();
+    std::cout << "Switches: " << count << " avg: " << prepare.average() << " usec, segments: " << pool.size()
+              << " created: " << pool.created() << " bytes: " << pool.bytes() << std::endl;
+    return (pool.created() > 2) ? 1 : 0;
+  }
+
+  // Capture a window at 30 Hz, reporting its size. Move, resize or reopen it to verify it is followed.
+  if ((std::string(argv[1]) == "follow") && (argc >= 3))
+  {
+    const std::string needle = argv[2];
+    const size_t count = (argc >= 4) ? std::atoi(argv[3]) : 900;
+    const auto windows = sniff.getWindows();
+    const auto it = std::find_if(windows.begin(), windows.end(),
+                                 [&](const WindowInfo& w) { return w.name.find(needle) != std::string::npos; });
+    if (it == windows.end())
+    {
+      std::cout << "Could not find any window with " << needle << " in the name." << std::endl;
+      return 1;
+    }
+    sniff.selectWindow(*it);
+    Limiter limiter{ 30 };
+    Measure grab;
+    size_t failed = 0;
+    std::pair<size_t, size_t> size;
+    for (size_t c = 0; c < count; c++)
+    {
+      limiter.sleep();
+      grab.start();
+      const bool success = sniff.grabContent();
+      grab.stop();
+      if (!success)
+      {
+        failed++;
+        continue;
+      }
+      auto screen = sniff.getScreen();
+      if (size != std::make_pair(screen->getWidth(), screen->getHeight()))
+      {
+        size = std::make_pair(screen->getWidth(), screen->getHeight());
+        std::cout << "Capturing " << size.first << " x " << size.second << std::endl;
+      }
+    }
+    std::cout << "Frames: " << count << " failed: " << failed << " avg: " << grab.average() << " usec" << std::endl;
+    return 0;
+  }
+
   if ((std::string(argv[1]) == "grabroot"))
   {
     sniff.selectRootWindow();
@@ -19,8 +19,13 @@
 */
 #ifndef TIMING_H
 #define TIMING_H
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <thread>
+#include <vector>
 
 /**
  * @brief Limit a loop to a certain rate in hz, sleeps the appropriate amount since last sleep to ensure we leave sleep
@@ -41,6 +46,14 @@ public:
   {
   }
 
+  /**
+   * @brief Change the rate, this takes effect from the next sleep onwards.
+   */
+  void setRate(double hz)
+  {
+    period_us = 1e6 / hz;
+  }
+
   /**
    * @brief Perform the sleep necessary to maintain the rate.
    */
@@ -57,6 +70,219 @@ public:
   }
 };
 
+/**
+ * @brief Adapts the rate of a loop to the motion in the canvas it produces. The motion is the mean difference of the
+ *        color channels between consecutive canvases, per second, such that it doesn't depend on the rate itself.
+ *        Motion above the high threshold doubles the rate, up to the maximum. Once the motion stayed below the low
+ *        threshold for the hold duration the rate is halved, down to the minimum. Motion between the two thresholds
+ *        keeps the current rate, this hysteresis prevents the rate from oscillating.
+ */
+struct RateController
+{
+  /**
+   * @brief The limits and thresholds of the controller.
+   */
+  struct Settings
+  {
+    double min_hz{ 10 };     //!< The floor of the rate, used for static content.
+    double max_hz{ 120 };    //!< The ceiling of the rate, used for fast motion.
+    double low{ 20 };        //!< Motion below which the rate is lowered, channel levels per second.
+    double high{ 150 };      //!< Motion above which the rate is raised, channel levels per second.
+    double hold_ms{ 1000 };  //!< Duration the motion has to stay below the low threshold before lowering the rate.
+  };
+
+private:
+  Settings settings_;                                    //!< The limits and thresholds.
+  double rate_;                                          //!< The current rate in hz.
+  Limiter limiter_;                                      //!< Limiter that sleeps at the current rate.
+  std::vector<std::array<uint8_t, 3>> previous_;         //!< The colors of the previous canvas.
+  std::chrono::steady_clock::time_point previous_time_;  //!< Time of the previous canvas.
+  std::chrono::steady_clock::time_point calm_since_;     //!< Start of the period of motion below the low threshold.
+  bool calm_{ false };                                   //!< Whether the motion is currently below the low threshold.
+  double motion_{ 0 };                                   //!< The last motion.
+
+public:
+  /**
+   * @brief Create the controller, starting at the provided rate which is clamped to the limits.
+   */
+  RateController(const Settings& settings, double hz)
+    : settings_(settings)
+    , rate_(std::min(settings.max_hz, std::max(settings.min_hz, hz)))
+    , limiter_(rate_)
+  {
+  }
+
+  /**
+   * @brief Perform the sleep necessary to maintain the current rate.
+   */
+  void sleep()
+  {
+    limiter_.sleep();
+  }
+
+  /**
+   * @brief Determine the motion since the previous canvas and adapt the rate to it.
+   * @param canvas Indexable canvas of colors, either a vector of colors or a view on the lights' frame.
+   * @param now The time the canvas was produced.
+   */
+  template <typename Canvas>
+  void update(const Canvas& canvas, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now())
+  {
+    uint64_t difference = 0;
+    const bool comparable = previous_.size() == canvas.size();
+    previous_.resize(canvas.size());
+    for (size_t i = 0; i < canvas.size(); i++)
+    {
+      const auto& color = canvas[i];
+      auto& previous = previous_[i];
+      difference += std::abs(color.R - previous[0]) + std::abs(color.G - previous[1]) + std::abs(color.B - previous[2]);
+      previous = { color.R, color.G, color.B };
+    }
+    const std::chrono::duration<double> dt = now - previous_time_;
+    previous_time_ = now;
+    if (!comparable || canvas.size() == 0 || dt.count() <= 0)
+    {
+      return;
+    }
+    adapt(difference / (3.0 * canvas.size()) / dt.count(), now);
+  }
+
+  /**
+   * @brief Adapt the rate to the provided motion, in channel levels per second.
+   */
+  void adapt(double motion, std::chrono::steady_clock::time_point now)
+  {
+    motion_ = motion;
+    if (motion > settings_.high)
+    {
+      calm_ = false;
+      setRate(rate_ * 2);
+      return;
+    }
+    if (motion >= settings_.low)
+    {
+      calm_ = false;
+      return;
+    }
+    if (!calm_)
+    {
+      calm_ = true;
+      calm_since_ = now;
+    }
+    if (std::chrono::duration<double, std::milli>(now - calm_since_).count() >= settings_.hold_ms)
+    {
+      calm_since_ = now;  // Hold the lowered rate before lowering it further.
+      setRate(rate_ / 2);
+    }
+  }
+
+  /**
+   * @brief Return the current rate in hz.
+   */
+  double rate() const
+  {
+    return rate_;
+  }
+
+  /**
+   * @brief Return the motion that was last adapted to, in channel levels per second.
+   */
+  double motion() const
+  {
+    return motion_;
+  }
+
+private:
+  void setRate(double hz)
+  {
+    rate_ = std::min(settings_.max_hz, std::max(settings_.min_hz, hz));
+    limiter_.setRate(rate_);
+  }
+};
+
+/**
+ * @brief Picks one of several levels of sample density such that sampling a frame stays within a time budget. Each
+ *        level is expected to take about twice as long as the one below it. The level is lowered as soon as the
+ *        smoothed duration exceeds the budget and raised once the next level has fit in the budget for a while.
+ */
+struct DensityController
+{
+  /**
+   * @brief The budget and levels of the controller.
+   */
+  struct Settings
+  {
+    double budget_us{ 2000 };  //!< The time sampling a frame may take, in microseconds.
+    size_t levels{ 7 };        //!< The number of density levels.
+    size_t hold_frames{ 60 };  //!< Frames the next level has to fit in the budget before raising the level.
+    double headroom{ 0.8 };    //!< Fraction of the budget the next level is expected to stay below.
+  };
+
+private:
+  Settings settings_;           //!< The budget and levels.
+  size_t level_;                //!< The current level.
+  double average_us_{ 0 };      //!< Smoothed duration of sampling a frame at the current level.
+  bool measured_{ false };      //!< Whether the average holds a duration.
+  size_t fitting_frames_{ 0 };  //!< Consecutive frames in which the next level would have fit in the budget.
+
+public:
+  /**
+   * @brief Create the controller, starting at the provided level which is clamped to the levels.
+   */
+  DensityController(const Settings& settings, size_t level)
+    : settings_(settings), level_(std::min(level, settings.levels ? settings.levels - 1 : 0))
+  {
+  }
+
+  /**
+   * @brief Adapt the level to the duration of sampling a frame.
+   * @param duration_us The time sampling the last frame took, in microseconds.
+   * @return True if the level changed.
+   */
+  bool update(double duration_us)
+  {
+    // Smooth the durations, a single slow frame shouldn't throw away the density.
+    average_us_ = measured_ ? (average_us_ * 0.8 + duration_us * 0.2) : duration_us;
+    measured_ = true;
+    if ((average_us_ > settings_.budget_us) && (level_ > 0))
+    {
+      level_--;
+      average_us_ /= 2;
+      fitting_frames_ = 0;
+      return true;
+    }
+    if ((average_us_ * 2 < settings_.budget_us * settings_.headroom) && (level_ + 1 < settings_.levels))
+    {
+      if (++fitting_frames_ >= settings_.hold_frames)
+      {
+        level_++;
+        average_us_ *= 2;
+        fitting_frames_ = 0;
+        return true;
+      }
+      return false;
+    }
+    fitting_frames_ = 0;
+    return false;
+  }
+
+  /**
+   * @brief Return the current level.
+   */
+  size_t level() const
+  {
+    return level_;
+  }
+
+  /**
+   * @brief Return the smoothed duration of sampling a frame, in microseconds.
+   */
+  double average() const
+  {
+    return average_us_;
+  }
+};
+
 /**
  * @brief Calculate cumulative time spent and average duration.
  */
@@ -78,12 +304,14 @@ public:
 
   /**
    * @brief Stop time measurement adding the duration since the last start to the accumulated time.
+   * @return The duration since the last start, in microseconds.
    */
-  void stop()
+  double stop()
   {
-    auto diff = std::chrono::steady_clock::now() - start_;
+    std::chrono::duration<double, std::micro> diff = std::chrono::steady_clock::now() - start_;
     cumulative_ += diff;
     count_++;
+    return diff.count();
   }
 
   /**
@@ -103,4 +331,65 @@ public:
   }
 };
 
+/**
+ * @brief Histogram of durations, with exponentially growing buckets. The upper bound of bucket i is 2^i microseconds,
+ *        the last bucket also holds everything beyond that.
+ */
+struct Histogram
+{
+  static constexpr const size_t bucket_count{ 24 };  //!< Upper bound of the last bucket is ~8 seconds.
+
+  std::array<size_t, bucket_count> buckets{};  //!< The number of durations in each bucket.
+  size_t count{ 0 };                           //!< The total number of durations.
+  double sum{ 0 };                             //!< Sum of all durations, in microseconds.
+
+  /**
+   * @brief Return the upper bound of a bucket, in microseconds.
+   */
+  static double upperBound(size_t bucket)
+  {
+    return static_cast<double>(1ULL << bucket);
+  }
+
+  /**
+   * @brief Return the bucket a duration in microseconds belongs in.
+   */
+  static size_t bucketIndex(double duration_us)
+  {
+    size_t bucket = 0;
+    while ((bucket < bucket_count - 1) && (duration_us > upperBound(bucket)))
+    {
+      bucket++;
+    }
+    return bucket;
+  }
+
+  /**
+   * @brief Add a duration in microseconds to the histogram.
+   */
+  void add(double duration_us)
+  {
+    buckets[bucketIndex(duration_us)]++;
+    count++;
+    sum += duration_us;
+  }
+
+  /**
+   * @brief Return the upper bound of the bucket in which the provided fraction (0.0 - 1.0) of durations lies.
+   */
+  double percentile(double fraction) const
+  {
+    size_t cumulative = 0;
+    for (size_t i = 0; i < bucket_count; i++)
+    {
+      cumulative += buckets[i];
+      if ((count != 0) && (cumulative >= fraction * count))
+      {
+        return upperBound(i);
+      }
+    }
+    return 0.0;
+  }
+};
+
 #endif
\ No newline at end of file
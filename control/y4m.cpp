@@ -0,0 +1,309 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "y4m.h"
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+Y4MReader::Y4MReader(const std::string& filename) : filename_(filename), in_(filename, std::ios::binary)
+{
+  if (!in_)
+  {
+    throw std::runtime_error("Failed to open " + filename);
+  }
+
+  // The header is a single line of space separated parameters, each starting with a tag character.
+  std::string header;
+  std::getline(in_, header);
+  std::stringstream ss(header);
+  std::string token;
+  ss >> token;
+  if (token != "YUV4MPEG2")
+  {
+    throw std::runtime_error("Not a YUV4MPEG2 video: " + filename);
+  }
+  std::string colorspace = "420jpeg";  // The default if the header doesn't state it.
+  while (ss >> token)
+  {
+    const char tag = token.front();
+    const std::string value = token.substr(1);
+    if (tag == 'W')
+    {
+      width_ = std::stoul(value);
+    }
+    else if (tag == 'H')
+    {
+      height_ = std::stoul(value);
+    }
+    else if (tag == 'F')
+    {
+      const auto colon = value.find(':');
+      rate_numerator_ = std::stoul(value.substr(0, colon));
+      rate_denominator_ = (colon == std::string::npos) ? 1 : std::stoul(value.substr(colon + 1));
+    }
+    else if (tag == 'C')
+    {
+      colorspace = value;
+    }
+  }
+  if (!width_ || !height_ || !rate_denominator_)
+  {
+    throw std::runtime_error("Invalid YUV4MPEG2 header: " + header);
+  }
+
+  if ((colorspace == "420") || (colorspace == "420jpeg") || (colorspace == "420mpeg2") || (colorspace == "420paldv"))
+  {
+    chroma_width_ = (width_ + 1) / 2;
+    chroma_height_ = (height_ + 1) / 2;
+  }
+  else if (colorspace == "422")
+  {
+    chroma_width_ = (width_ + 1) / 2;
+    chroma_height_ = height_;
+  }
+  else if (colorspace == "444")
+  {
+    chroma_width_ = width_;
+    chroma_height_ = height_;
+  }
+  else if (colorspace != "mono")
+  {
+    throw std::runtime_error("Unsupported YUV4MPEG2 colorspace: " + colorspace);
+  }
+
+  planes_.resize(frameSize());
+  u_row_.resize(width_, 128);  // Mono has no chroma, it stays neutral.
+  v_row_.resize(width_, 128);
+  first_frame_ = in_.tellg();
+}
+
+size_t Y4MReader::frameSize() const
+{
+  return width_ * height_ + 2 * chroma_width_ * chroma_height_;
+}
+
+bool Y4MReader::readFrameHeader()
+{
+  std::string line;
+  if (!std::getline(in_, line))
+  {
+    return false;
+  }
+  if (line.compare(0, 5, "FRAME") != 0)
+  {
+    throw std::runtime_error("Malformed frame header in " + filename_);
+  }
+  return true;
+}
+
+bool Y4MReader::read(Image::Bitmap& frame)
+{
+  if (!readFrameHeader() || !in_.read(reinterpret_cast<char*>(planes_.data()), planes_.size()))
+  {
+    return false;  // A truncated frame ends the video as well.
+  }
+  if ((frame.size() != height_) || (frame.front().size() != width_))
+  {
+    frame.assign(height_, std::vector<uint32_t>(width_, 0));
+  }
+
+  const uint8_t* y_plane = planes_.data();
+  const uint8_t* u_plane = y_plane + width_ * height_;
+  const uint8_t* v_plane = u_plane + chroma_width_ * chroma_height_;
+  size_t expanded_row = std::numeric_limits<size_t>::max();
+  for (size_t y = 0; y < height_; y++)
+  {
+    const uint8_t* u = u_row_.data();
+    const uint8_t* v = v_row_.data();
+    const size_t chroma_y = (chroma_height_ == height_) ? y : y / 2;
+    if (chroma_width_ == width_)
+    {
+      u = u_plane + y * width_;
+      v = v_plane + y * width_;
+    }
+    else if (chroma_width_ && (chroma_y != expanded_row))
+    {
+      // Repeat each chroma sample for the pixels it covers, such that the conversion runs over plain rows. Rows that
+      // share their chroma with the previous row reuse it.
+      expanded_row = chroma_y;
+      const uint8_t* u_source = u_plane + chroma_y * chroma_width_;
+      const uint8_t* v_source = v_plane + chroma_y * chroma_width_;
+      for (size_t x = 0; x < width_; x++)
+      {
+        u_row_[x] = u_source[x / 2];
+        v_row_[x] = v_source[x / 2];
+      }
+    }
+    convertRow(y_plane + y * width_, u, v, frame[y].data(), width_);
+  }
+  return true;
+}
+
+bool Y4MReader::skip()
+{
+  if (!readFrameHeader())
+  {
+    return false;
+  }
+  in_.seekg(frameSize(), std::ios::cur);
+  return static_cast<bool>(in_);
+}
+
+void Y4MReader::rewind()
+{
+  in_.clear();
+  in_.seekg(first_frame_);
+}
+
+size_t Y4MReader::width() const
+{
+  return width_;
+}
+
+size_t Y4MReader::height() const
+{
+  return height_;
+}
+
+double Y4MReader::frameRate() const
+{
+  return static_cast<double>(rate_numerator_) / rate_denominator_;
+}
+
+void Y4MReader::convertRow(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* rgb, size_t width)
+{
+  // Fixed point BT.601, a loop without branches over plain arrays that the compiler vectorizes.
+  for (size_t x = 0; x < width; x++)
+  {
+    const int32_t c = 298 * (static_cast<int32_t>(y[x]) - 16) + 128;
+    const int32_t d = static_cast<int32_t>(u[x]) - 128;
+    const int32_t e = static_cast<int32_t>(v[x]) - 128;
+    const int32_t r = std::min(255, std::max(0, (c + 409 * e) >> 8));
+    const int32_t g = std::min(255, std::max(0, (c - 100 * d - 208 * e) >> 8));
+    const int32_t b = std::min(255, std::max(0, (c + 516 * d) >> 8));
+    rgb[x] = (static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | static_cast<uint32_t>(b);
+  }
+}
+
+Y4MWriter::Y4MWriter(const std::string& filename, size_t width, size_t height, uint32_t rate_numerator,
+                     uint32_t rate_denominator)
+  : out_(filename, std::ios::binary), width_(width), height_(height)
+{
+  if (!out_)
+  {
+    throw std::runtime_error("Failed to open " + filename);
+  }
+  if ((rate_numerator == 0) || (rate_denominator == 0))
+  {
+    throw std::runtime_error("Invalid frame rate " + std::to_string(rate_numerator) + ":" +
+                             std::to_string(rate_denominator));
+  }
+
+  // State the rate as the smallest fraction.
+  uint32_t a = rate_numerator;
+  uint32_t b = rate_denominator;
+  while (b)
+  {
+    a = a % b;
+    std::swap(a, b);
+  }
+  out_ << "YUV4MPEG2 W" << width << " H" << height << " F" << rate_numerator / a << ":" << rate_denominator / a
+       << " Ip A1:1 C420jpeg\n";
+  const size_t chroma_width = (width + 1) / 2;
+  planes_.resize(width * height + 2 * chroma_width * ((height + 1) / 2));
+  u_sums_.resize(chroma_width);
+  v_sums_.resize(chroma_width);
+  row_.resize(width);
+  u_row_.resize(chroma_width * 2);
+  v_row_.resize(chroma_width * 2);
+}
+
+bool Y4MWriter::write(const Image& image)
+{
+  if ((image.getWidth() != width_) || (image.getHeight() != height_))
+  {
+    return false;
+  }
+
+  const size_t chroma_width = (width_ + 1) / 2;
+  const size_t chroma_height = (height_ + 1) / 2;
+  uint8_t* y_plane = planes_.data();
+  uint8_t* u_plane = y_plane + width_ * height_;
+  uint8_t* v_plane = u_plane + chroma_width * chroma_height;
+  for (size_t chroma_y = 0; chroma_y < chroma_height; chroma_y++)
+  {
+    // The chroma of each 2x2 block of pixels is the average of its pixels.
+    std::fill(u_sums_.begin(), u_sums_.end(), 0);
+    std::fill(v_sums_.begin(), v_sums_.end(), 0);
+    const size_t rows = std::min<size_t>(2, height_ - 2 * chroma_y);
+    for (size_t y = 2 * chroma_y; y < 2 * chroma_y + rows; y++)
+    {
+      image.copyRow(y, row_.data());
+      convertRow(row_.data(), y_plane + y * width_, u_row_.data(), v_row_.data(), width_);
+      for (size_t chroma_x = 0; chroma_x < chroma_width; chroma_x++)
+      {
+        // The values beyond an odd width stay zero.
+        u_sums_[chroma_x] += u_row_[2 * chroma_x] + u_row_[2 * chroma_x + 1];
+        v_sums_[chroma_x] += v_row_[2 * chroma_x] + v_row_[2 * chroma_x + 1];
+      }
+    }
+    for (size_t chroma_x = 0; chroma_x < chroma_width; chroma_x++)
+    {
+      const int32_t count = static_cast<int32_t>(rows * std::min<size_t>(2, width_ - 2 * chroma_x));
+      u_plane[chroma_y * chroma_width + chroma_x] = static_cast<uint8_t>((u_sums_[chroma_x] + count / 2) / count);
+      v_plane[chroma_y * chroma_width + chroma_x] = static_cast<uint8_t>((v_sums_[chroma_x] + count / 2) / count);
+    }
+  }
+
+  out_ << "FRAME\n";
+  out_.write(reinterpret_cast<const char*>(planes_.data()), planes_.size());
+  frames_++;
+  return static_cast<bool>(out_);
+}
+
+void Y4MWriter::convertRow(const uint32_t* rgb, uint8_t* y, int32_t* u, int32_t* v, size_t width)
+{
+  // Fixed point BT.601, like the reader this is a loop the compiler vectorizes.
+  for (size_t x = 0; x < width; x++)
+  {
+    const int32_t r = (rgb[x] >> 16) & 0xFF;
+    const int32_t g = (rgb[x] >> 8) & 0xFF;
+    const int32_t b = rgb[x] & 0xFF;
+    y[x] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    u[x] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    v[x] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+  }
+}
+
+size_t Y4MWriter::frames() const
+{
+  return frames_;
+}
+
+size_t Y4MWriter::width() const
+{
+  return width_;
+}
+
+size_t Y4MWriter::height() const
+{
+  return height_;
+}
@@ -0,0 +1,167 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef Y4M_H
+#define Y4M_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "image.h"
+
+/**
+ * @brief Reads the frames of a YUV4MPEG2 (.y4m) video one at a time, converting them to the 0x00RRGGBB format of the
+ *        images. Only the planes of the current frame are held in memory, so videos of any length are read with
+ *        constant memory.
+ *
+ * The 420, 422, 444 and mono colorspaces with 8 bits per sample are supported, the conversion uses the BT.601 limited
+ * range coefficients that video is usually encoded with.
+ */
+class Y4MReader
+{
+public:
+  /**
+   * @brief Open a video and read its header, throws a std::runtime_error if it can't be read or is not supported.
+   */
+  Y4MReader(const std::string& filename);
+
+  /**
+   * @brief Read and convert the next frame.
+   * @param frame The bitmap to write to, it is only reallocated if its dimensions differ from the video.
+   * @return False at the end of the video.
+   */
+  bool read(Image::Bitmap& frame);
+
+  /**
+   * @brief Skip over the next frame without converting it.
+   * @return False at the end of the video.
+   */
+  bool skip();
+
+  /**
+   * @brief Start reading at the first frame again.
+   */
+  void rewind();
+
+  /**
+   * @brief Return the width of the video.
+   */
+  size_t width() const;
+
+  /**
+   * @brief Return the height of the video.
+   */
+  size_t height() const;
+
+  /**
+   * @brief Return the frame rate of the video in hz, as stated in its header.
+   */
+  double frameRate() const;
+
+  /**
+   * @brief Convert a row of pixels, the chroma samples are provided for each pixel.
+   */
+  static void convertRow(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* rgb, size_t width);
+
+private:
+  std::string filename_;            //!< The file being read.
+  std::ifstream in_;                //!< The stream of the file.
+  std::streampos first_frame_;      //!< Position of the first frame.
+  size_t width_{ 0 };               //!< Width of the luma plane.
+  size_t height_{ 0 };              //!< Height of the luma plane.
+  size_t chroma_width_{ 0 };        //!< Width of the chroma planes, 0 for mono.
+  size_t chroma_height_{ 0 };       //!< Height of the chroma planes, 0 for mono.
+  uint32_t rate_numerator_{ 25 };   //!< Numerator of the frame rate.
+  uint32_t rate_denominator_{ 1 };  //!< Denominator of the frame rate.
+  std::vector<uint8_t> planes_;     //!< The Y, U and V planes of the current frame, in that order.
+  std::vector<uint8_t> u_row_;      //!< U samples of the row being converted, one for each pixel.
+  std::vector<uint8_t> v_row_;      //!< V samples of the row being converted, one for each pixel.
+
+  /**
+   * @brief Read the header that precedes each frame.
+   * @return False at the end of the video.
+   */
+  bool readFrameHeader();
+
+  /**
+   * @brief Return the size of the planes of a frame in bytes.
+   */
+  size_t frameSize() const;
+};
+
+/**
+ * @brief Writes images to a YUV4MPEG2 (.y4m) video in the 420 colorspace, for example to preview the output of the
+ *        analysis with a video player. The conversion uses the BT.601 limited range coefficients.
+ */
+class Y4MWriter
+{
+public:
+  /**
+   * @brief Create a video, throws a std::runtime_error if the file can't be opened.
+   * @param filename The file to write to, it is overwritten.
+   * @param width The width of the frames.
+   * @param height The height of the frames.
+   * @param rate_numerator The numerator of the frame rate stated in the header, in hz.
+   * @param rate_denominator The denominator of the frame rate, such that rates below 1 hz and fractional rates can be
+   *        stated.
+   */
+  Y4MWriter(const std::string& filename, size_t width, size_t height, uint32_t rate_numerator = 60,
+            uint32_t rate_denominator = 1);
+
+  /**
+   * @brief Add a frame to the video.
+   * @return False if the image has different dimensions than the video or writing failed.
+   */
+  bool write(const Image& image);
+
+  /**
+   * @brief Return the number of frames written.
+   */
+  size_t frames() const;
+
+  /**
+   * @brief Return the width of the frames.
+   */
+  size_t width() const;
+
+  /**
+   * @brief Return the height of the frames.
+   */
+  size_t height() const;
+
+  /**
+   * @brief Convert a row of pixels, the chroma samples are computed for each pixel.
+   */
+  static void convertRow(const uint32_t* rgb, uint8_t* y, int32_t* u, int32_t* v, size_t width);
+
+private:
+  std::ofstream out_;            //!< The stream of the file.
+  size_t width_;                 //!< Width of the frames.
+  size_t height_;                //!< Height of the frames.
+  size_t frames_{ 0 };           //!< Number of frames written.
+  std::vector<uint8_t> planes_;  //!< The Y, U and V planes of the frame being written.
+  std::vector<int32_t> u_sums_;  //!< Sum of the U values of each 2x2 block of the row pair being written.
+  std::vector<int32_t> v_sums_;  //!< Sum of the V values of each 2x2 block of the row pair being written.
+  std::vector<uint32_t> row_;    //!< Pixels of the row being converted.
+  std::vector<int32_t> u_row_;   //!< U value of each pixel of the row being converted.
+  std::vector<int32_t> v_row_;   //!< V value of each pixel of the row being converted.
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+  The MIT License (MIT)
+  Copyright (c) 2019 Ivor Wanders
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef FIRMWARE_INTERPOLATOR_H
+#define FIRMWARE_INTERPOLATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Interpolates the colors of N leds from the colors shown at the moment a new keyframe is committed towards that
+ *        keyframe, over the duration of the keyframe. This allows the firmware to output at a higher rate than the
+ *        host sends frames. All arithmetic is fixed point, this does not depend on anything Arduino specific so it is
+ *        also compiled and tested on the host.
+ */
+template <size_t N>
+class Interpolator
+{
+public:
+  struct Color
+  {
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+  };
+
+  Interpolator()
+  {
+    for (size_t i = 0; i < N; i++)
+    {
+      start_[i] = target_[i] = next_[i] = current_[i] = Color{ 0, 0, 0 };
+    }
+  }
+
+  /**
+   * @brief Set the color of a led in the next keyframe, this takes effect at the next commit.
+   */
+  void setNext(size_t index, uint8_t r, uint8_t g, uint8_t b)
+  {
+    if (index < N)
+    {
+      next_[index] = Color{ r, g, b };
+    }
+  }
+
+  /**
+   * @brief Start transitioning from the current colors towards the next keyframe.
+   * @param now_us The current time in microseconds, may wrap around.
+   * @param duration_us The duration of the transition, 0 shows the keyframe at the next update.
+   */
+  void commit(uint32_t now_us, uint32_t duration_us)
+  {
+    update(now_us);
+    for (size_t i = 0; i < N; i++)
+    {
+      start_[i] = current_[i];
+      target_[i] = next_[i];
+    }
+    start_us_ = now_us;
+    duration_us_ = duration_us;
+    done_ = false;
+  }
+
+  /**
+   * @brief Compute the current colors.
+   * @return True if the current colors changed since the last update, false if the transition was already done.
+   */
+  bool update(uint32_t now_us)
+  {
+    if (done_)
+    {
+      return false;
+    }
+
+    // Fraction of the transition that has elapsed, 16 bit fixed point.
+    const uint32_t elapsed = now_us - start_us_;
+    uint32_t fraction = 1 << 16;
+    if (elapsed < duration_us_)
+    {
+      fraction = (static_cast<uint64_t>(elapsed) << 16) / duration_us_;
+    }
+    else
+    {
+      done_ = true;
+    }
+
+    for (size_t i = 0; i < N; i++)
+    {
+      current_[i].R = blend(start_[i].R, target_[i].R, fraction);
+      current_[i].G = blend(start_[i].G, target_[i].G, fraction);
+      current_[i].B = blend(start_[i].B, target_[i].B, fraction);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Decrease all colors by amount, stopping at zero, and stop the transition.
+   */
+  void decay(uint8_t amount)
+  {
+    for (size_t i = 0; i < N; i++)
+    {
+      current_[i].R = (current_[i].R > amount) ? current_[i].R - amount : 0;
+      current_[i].G = (current_[i].G > amount) ? current_[i].G - amount : 0;
+      current_[i].B = (current_[i].B > amount) ? current_[i].B - amount : 0;
+      start_[i] = target_[i] = current_[i];
+    }
+    done_ = true;
+  }
+
+  /**
+   * @brief Return the color of a led as computed by the last update.
+   */
+  const Color& current(size_t index) const
+  {
+    return current_[index];
+  }
+
+  /**
+   * @brief Return true if the transition towards the committed keyframe is complete.
+   */
+  bool done() const
+  {
+    return done_;
+  }
+
+private:
+  static uint8_t blend(uint8_t from, uint8_t to, uint32_t fraction)
+  {
+    const int32_t delta = static_cast<int32_t>(to) - static_cast<int32_t>(from);
+    return from + ((delta * static_cast<int32_t>(fraction)) >> 16);
+  }
+
+  Color start_[N];    //!< Colors at the moment the keyframe was committed.
+  Color target_[N];   //!< Colors of the committed keyframe.
+  Color next_[N];     //!< Colors of the next keyframe, being received.
+  Color current_[N];  //!< Colors computed by the last update.
+
+  uint32_t start_us_{ 0 };     //!< Time the keyframe was committed.
+  uint32_t duration_us_{ 0 };  //!< Duration of the transition.
+  bool done_{ true };          //!< True if the transition is complete.
+};
+
+#endif
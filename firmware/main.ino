@@ -19,6 +19,7 @@
 */
 #include <OctoWS2811.h>
 #include "messages.h"
+#include "interpolator.h"
 
 // Setup OctoWS2811
 const int ledsInStrip = 228;
@@ -36,6 +37,14 @@ Config config;  //!< Currently active config.
 elapsedMillis decay_last_event;  //!< Keeps track of when the last event was detected.
 elapsedMicros decay_interval;    //!< Keeps track of last decay cycle.
 
+/*
+  Received colors are keyframes, the interpolator transitions towards them at the output rate. The colors in the
+  interpolator are not gamma corrected yet.
+*/
+Interpolator<ledsInStrip> interpolator;
+elapsedMicros interpolation_interval;  //!< Keeps track of the last interpolation output.
+const uint32_t interpolation_interval_us = 5000;  //!< Output interval during transitions, clocking out takes ~7ms.
+
 // Gamma tables.
 uint8_t r_gamma[256] = { 0 };
 uint8_t g_gamma[256] = { 0 };
@@ -98,6 +107,44 @@ void setup()
   delay(3000);
 }
 
+/**
+ * @brief Write the interpolator's current colors to the leds with gamma correction and show them.
+ */
+void showInterpolated()
+{
+  for (int j = 0; j < ledsInStrip; j++)
+  {
+    const auto& c = interpolator.current(j);
+    leds.setPixel(j, r_gamma[c.R], g_gamma[c.G], b_gamma[c.B]);
+  }
+  leds.show();
+}
+
+/**
+ * @brief Commit the received keyframe and show the first step of the transition towards it.
+ */
+void showKeyframe(const Message& msg)
+{
+  const uint32_t now = micros();
+  interpolator.commit(now, static_cast<uint32_t>(msg.transition_ms) * 1000);
+  interpolator.update(now);
+  showInterpolated();
+  interpolation_interval = 0;
+}
+
+void loopInterpolate()
+{
+  // Only output while a transition is running, and don't block on the previous output still being clocked out.
+  if ((interpolation_interval >= interpolation_interval_us) && !leds.busy())
+  {
+    interpolation_interval = 0;
+    if (interpolator.update(micros()))
+    {
+      showInterpolated();
+    }
+  }
+}
+
 void loopDecay()
 {
   if (config.decay_time_delay_ms == 0)
@@ -106,39 +153,37 @@ void loopDecay()
     return;
   }
 
-  // decay enabled
+  // decay enabled, the delay counts from the end of the transition such that long transitions complete.
+  if (!interpolator.done())
+  {
+    decay_last_event = 0;
+  }
   if (decay_last_event >= config.decay_time_delay_ms)
   {
     if (decay_interval >= config.decay_interval_us)
     {
-      for (int j = 0; j < ledsInStrip; j++)
-      {
-        // Serial.print("j: "); Serial.println(j); delay(10);
-        const int c = leds.getPixel(j);
-
-        // Decompose the color
-        int16_t R = (c >> 16) & 0xFF;
-        int16_t G = (c >> 8) & 0xFF;
-        int16_t B = (c >> 0) & 0xFF;
-
-        // Perform the decay
-        R = (R - config.decay_amount);
-        G = (G - config.decay_amount);
-        B = (B - config.decay_amount);
-
-        // Prevent underflow
-        R = (R < 0) ? 0 : R;
-        G = (G < 0) ? 0 : G;
-        B = (B < 0) ? 0 : B;
-  
-        leds.setPixel(j, R, G, B);
-      }
-      leds.show();
+      interpolator.decay(config.decay_amount);
+      showInterpolated();
       decay_interval = 0;
     }
   }
 }
 
+/**
+ * @brief Acknowledge a shown frame if the host requested it. Color messages of both encodings share the settings.
+ */
+void sendAck(const Message& msg)
+{
+  if (msg.color.settings & msg.color.settings_ack)
+  {
+    Ack ack;
+    ack.type = ACK;
+    ack.sequence = msg.sequence;
+    Serial.write(reinterpret_cast<const uint8_t*>(&ack), sizeof(ack));
+    Serial.send_now();
+  }
+}
+
 void processCommand(const Message& msg)
 {
   switch (msg.type)
@@ -155,23 +200,38 @@ void processCommand(const Message& msg)
       if (msg.color.settings & msg.color.settings_set_all)
       {
         // setting all colors
-        fill(leds.color(msg.color.color[0].R, msg.color.color[0].G, msg.color.color[0].B));
+        for (uint16_t i = 0; i < ledsInStrip; i++)
+        {
+          interpolator.setNext(i, msg.color.color[0].R, msg.color.color[0].G, msg.color.color[0].B);
+        }
       }
       else
       {
         // setting individual colors
         for (uint16_t i = 0; i < sizeof(msg.color.color) / sizeof(msg.color.color[0]); i++)
         {
-          const uint8_t r_corrected = r_gamma[msg.color.color[i].R];
-          const uint8_t g_corrected = g_gamma[msg.color.color[i].G];
-          const uint8_t b_corrected = b_gamma[msg.color.color[i].B];
-          leds.setPixel(i + msg.color.offset, r_corrected, g_corrected, b_corrected);
+          interpolator.setNext(i + msg.color.offset, msg.color.color[i].R, msg.color.color[i].G, msg.color.color[i].B);
         }
       }
       // If set, then show the leds.
       if (msg.color.settings & msg.color.settings_show_after)
       {
-        leds.show();
+        showKeyframe(msg);
+        sendAck(msg);
+      }
+    break;
+
+    case COLOR_RGB565:
+      // The last message is not completely filled, the interpolator ignores leds beyond the strip.
+      for (uint16_t i = 0; i < msg.color565.leds_per_message; i++)
+      {
+        const RGB c = ColorData565::decode(msg.color565.color[i]);
+        interpolator.setNext(i + msg.color565.offset, c.R, c.G, c.B);
+      }
+      if (msg.color565.settings & msg.color.settings_show_after)
+      {
+        showKeyframe(msg);
+        sendAck(msg);
       }
     break;
 
@@ -198,6 +258,7 @@ void loop()
 {
   loopDecay();
   loopSerial();
+  loopInterpolate();
 }
 
 void createGammaTable(uint8_t* table, float gamma)
@@ -36,7 +36,9 @@ enum MsgType : uint8_t
 {
   NOP = 0,
   CONFIG = 1,
-  COLOR = 2
+  COLOR = 2,
+  COLOR_RGB565 = 3,
+  ACK = 4
 };
 
 struct Config
@@ -60,20 +62,54 @@ struct ColorData
   static constexpr const size_t leds_per_message{ 19 };
   static constexpr const size_t settings_show_after{ 1 << 0 };
   static constexpr const size_t settings_set_all{ 1 << 1 };
+  static constexpr const size_t settings_ack{ 1 << 2 };  // Send an Ack after showing, requires settings_show_after.
   uint16_t offset;
   uint8_t settings;
   RGB color[leds_per_message];  // takes 12 messages to send 228 bytes
 };
 
+struct ColorData565
+{
+  static constexpr const size_t leds_per_message{ 28 };
+  uint16_t offset;
+  uint8_t settings;                  // same flags as ColorData.
+  uint8_t _;                         // padding
+  uint16_t color[leds_per_message];  // 5 bits red, 6 bits green, 5 bits blue, takes 9 messages to send 228 leds.
+
+  static uint16_t encode(uint8_t r, uint8_t g, uint8_t b)
+  {
+    // Round to the nearest representable value.
+    return ((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+  }
+
+  static RGB decode(uint16_t c)
+  {
+    // Replicate the high bits into the low bits, this maps the extremes to 0 and 255.
+    const uint8_t r = (c >> 11) & 0x1F;
+    const uint8_t g = (c >> 5) & 0x3F;
+    const uint8_t b = c & 0x1F;
+    return RGB{ uint8_t((r << 3) | (r >> 2)), uint8_t((g << 2) | (g >> 4)), uint8_t((b << 3) | (b >> 2)) };
+  }
+};
+
 struct Message
 {
   MsgType type;
-  uint8_t _[3];  // padding
+  uint8_t sequence;        // frame sequence number, echoed in the Ack.
+  uint16_t transition_ms;  // duration of the transition to a shown frame, 0 shows it immediately.
   union {
     ColorData color;
+    ColorData565 color565;
     Config config;
     uint8_t raw[60];
   };
 };  // exactly 64 bytes long = 1 usb packet.
 
+// Sent by the device to the host after showing a frame that requested it.
+struct Ack
+{
+  MsgType type;      // always ACK.
+  uint8_t sequence;  // sequence of the message that was shown.
+};
+
 #endif
\ No newline at end of file